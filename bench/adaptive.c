@@ -0,0 +1,98 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+// Compares the whitespace kernel chosen by prsr_scan_profile against both fixed choices.
+// usage: ./bench/run.sh adaptive <file.js>...
+
+#include "../token.h"
+#include <string.h>
+#include "lex.h"
+#include "util.h"
+
+#define RUNS 30
+
+#define MODE__INDEX    0
+#define MODE__SCALAR   1
+#define MODE__ADAPTIVE 2
+
+static uint64_t run_tokens(char *buf, int mode) {
+  uint64_t start = now_ns();
+  benchlex l;
+  benchlex_init(&l, buf);
+  if (mode != MODE__ADAPTIVE) {
+    l.td.index.scalar_space = (mode == MODE__SCALAR);
+  }
+
+  token out;
+  while (l.td.next.type) {
+    benchlex_next(&l, &out);  // nb. errors still consume a token
+  }
+  return now_ns() - start;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <file.js>...\n", argv[0]);
+    return 1;
+  }
+  printf("kernel=%s\n", prsr_scan_kernel());
+  printf("%-32s %9s %9s %9s %9s\n", "file", "profile", "index", "scalar", "adaptive");
+
+  int worse = 0;
+  for (int i = 1; i < argc; ++i) {
+    int len;
+    char *buf = read_file(argv[i], &len);
+    if (!buf) {
+      fprintf(stderr, "can't read: %s\n", argv[i]);
+      return 1;
+    }
+
+    // interleave modes, rotating which goes first so that drift and warmup affect all equally
+    uint64_t best[3] = {UINT64_MAX, UINT64_MAX, UINT64_MAX};
+    for (int run = 0; run < RUNS * 3; ++run) {
+      int mode = (run + run / 3) % 3;
+      uint64_t ns = run_tokens(buf, mode);
+      if (ns < best[mode]) {
+        best[mode] = ns;
+      }
+    }
+
+    tokendef td = prsr_init_token(buf);
+    const char *profile = td.index.scalar_space ? "minified" : "pretty";
+    double mbs[3];
+    for (int mode = 0; mode < 3; ++mode) {
+      mbs[mode] = len * 1e3 / best[mode];
+    }
+
+    // allow 2% for noise
+    double fixed = mbs[MODE__INDEX] > mbs[MODE__SCALAR] ? mbs[MODE__INDEX] : mbs[MODE__SCALAR];
+    int is_worse = mbs[MODE__ADAPTIVE] < fixed * 0.98;
+    worse += is_worse;
+
+    const char *name = argv[i];
+    int name_len = strlen(name);
+    if (name_len > 32) {
+      name += name_len - 32;
+    }
+    printf("%-32s %9s %9.1f %9.1f %9.1f%s\n", name, profile,
+        mbs[MODE__INDEX], mbs[MODE__SCALAR], mbs[MODE__ADAPTIVE], is_worse ? " (worse)" : "");
+    free(buf);
+  }
+
+  printf("MB/s tokenizing, best of %d; adaptive worse than best fixed on %d/%d\n",
+      RUNS, worse, argc - 1);
+  return worse ? 1 : 0;
+}
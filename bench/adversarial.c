@@ -0,0 +1,148 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+// Times generated pathological inputs at growing sizes, to show that cost per byte stays flat.
+// usage: ./bench/run.sh adversarial [pattern]
+
+#include "../parser.h"
+#include <string.h>
+#include "lex.h"
+#include "util.h"
+
+#define RUNS       5
+#define MAX_GROWTH 2.0  // ns/byte at the largest size vs. the smallest
+
+static const int sizes[] = {64 << 10, 256 << 10, 1 << 20, 4 << 20};
+#define SIZE_COUNT ((int) (sizeof(sizes) / sizeof(int)))
+
+typedef struct {
+  const char *name;
+  const char *prefix;  // written once
+  const char *unit;    // repeated to fill
+  int nest;            // if non-zero, unit is wrapped in this many "(" and ")"
+} pattern;
+
+static const pattern patterns[] = {
+  // nested just under the stack limit, over and over
+  {"nest", "", "x", __STACK_SIZE - 16},
+  // nested past the stack limit, so this should fail fast
+  {"nest-overflow", "", "(", 0},
+  // slash after ")" is ambiguous, so the parser resolves it via prsr_close_op_next
+  {"slash-close", "", "(a)/(b)/", 0},
+  // slash at the start of a line is an op or regexp depending on ASI
+  {"slash-asi", "", "a\n/b/g\n", 0},
+  // template literal that never closes
+  {"template", "`", "text ${a} ", 0},
+  // block comment that never closes
+  {"comment", "/*", "* / ", 0},
+  // minified code without any newlines
+  {"line", "", "var a=b?c:d,e=[1,2,{f:g}];function h(i){return i/2}", 0},
+};
+#define PATTERN_COUNT ((int) (sizeof(patterns) / sizeof(pattern)))
+
+// builds a NUL-terminated input of about size bytes (always whole units)
+static char *generate(const pattern *p, int size, int *len) {
+  char *buf = malloc(size + 1);
+  int at = strlen(p->prefix);
+  memcpy(buf, p->prefix, at);
+
+  int unit_len = strlen(p->unit);
+  int need = unit_len + p->nest * 2;
+  while (at + need <= size) {
+    memset(buf + at, '(', p->nest);
+    at += p->nest;
+    memcpy(buf + at, p->unit, unit_len);
+    at += unit_len;
+    memset(buf + at, ')', p->nest);
+    at += p->nest;
+  }
+
+  buf[at] = 0;
+  *len = at;
+  return buf;
+}
+
+static void discard(void *arg, token *t) {
+  (void) arg;
+  (void) t;
+}
+
+// returns the best ns to tokenize or parse buf, stopping at the first error
+static uint64_t run(char *buf, int parse) {
+  uint64_t best = UINT64_MAX;
+  for (int i = 0; i < RUNS; ++i) {
+    uint64_t start = now_ns();
+    if (parse) {
+      tokendef td = prsr_init_token(buf);
+      prsr_simple(&td, 0, discard, NULL);
+    } else {
+      // nb. guesses each slash from the token before it, so slash patterns take both lexing paths
+      benchlex l;
+      benchlex_init(&l, buf);
+      token out;
+      while (l.td.next.type && !benchlex_next(&l, &out)) {
+      }
+    }
+    uint64_t ns = now_ns() - start;
+    if (ns < best) {
+      best = ns;
+    }
+  }
+  return best;
+}
+
+int main(int argc, char **argv) {
+  const char *only = argc > 1 ? argv[1] : NULL;
+
+  printf("kernel=%s\n%-14s %-8s", prsr_scan_kernel(), "pattern", "mode");
+  for (int i = 0; i < SIZE_COUNT; ++i) {
+    printf(" %7dK", sizes[i] >> 10);
+  }
+  printf(" %7s\n", "growth");
+
+  int nonlinear = 0;
+  for (int i = 0; i < PATTERN_COUNT; ++i) {
+    const pattern *p = &patterns[i];
+    if (only && strcmp(only, p->name)) {
+      continue;
+    }
+
+    for (int parse = 0; parse < 2; ++parse) {
+      printf("%-14s %-8s", p->name, parse ? "parse" : "tokenize");
+
+      double first = 0, last = 0;
+      for (int j = 0; j < SIZE_COUNT; ++j) {
+        int len;
+        char *buf = generate(p, sizes[j], &len);
+        last = (double) run(buf, parse) / len;
+        if (!j) {
+          first = last;
+        }
+        printf(" %8.2f", last);
+        fflush(stdout);
+        free(buf);
+      }
+
+      double growth = last / first;
+      int bad = growth > MAX_GROWTH;
+      nonlinear += bad;
+      printf(" %6.2fx%s\n", growth, bad ? " (nonlinear)" : "");
+    }
+  }
+
+  printf("ns/byte, best of %d; %d nonlinear (growth over %.1fx)\n", RUNS, nonlinear, MAX_GROWTH);
+  return nonlinear ? 1 : 0;
+}
@@ -0,0 +1,372 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+// Loads a corpus once, then times tokenizing and parsing it many times.
+// usage: ./bench/run.sh bench [-n runs] [-json] [-perf] [-save file] [-compare file [-tolerance pct]] <file>...
+
+#include "../parser.h"
+#include <string.h>
+#include "lex.h"
+#include "perf.h"
+#include "util.h"
+
+#define WARMUP 2
+
+#define MODE__TOKENIZE 0
+#define MODE__PARSE    1
+#define MODE__INTERN   2  // parse, interning literals
+#define MODE__STRINGS  3  // parse, decoding strings
+#define MODE__NUMBERS  4  // parse, decoding numbers
+#define MODE__PREPARSE 5  // parse, skipping function bodies
+#define MODE__COUNT    6
+
+static const char *mode_names[] = {"tokenize", "parse", "intern", "strings", "numbers", "preparse"};
+
+typedef struct {
+  char **buf;
+  int *len;
+  const char **path;
+  int count;
+  int64_t bytes;
+  int json;  // parse with prsr_json
+
+  prsr_intern intern;  // shared by all files, reset each run
+  prsr_intern_slot *slots;
+  int slots_size;
+
+  prsr_strings strings;  // reset for each file
+  char *strings_data;
+  prsr_string *strings_all;
+  int max_len;
+
+  prsr_numbers numbers;  // reset for each file
+  prsr_number *numbers_all;
+} corpus;
+
+typedef struct {
+  uint64_t median;
+  uint64_t p99;
+  int64_t tokens;
+  int64_t counters[PERF__COUNT];  // per run, or -1 if unavailable
+} result;
+
+static void count_token(void *arg, token *t) {
+  (void) t;
+  ++*(int64_t *) arg;
+}
+
+typedef struct {
+  int64_t tokens;
+  int errors;  // bodies that failed to parse
+} expanded;
+
+// counts tokens as count_token, but parses each TOKEN_BODY in place (without its EOF)
+static void count_expanded(void *arg, token *t) {
+  expanded *e = (expanded *) arg;
+  if (t->type == TOKEN_BODY) {
+    e->errors += (prsr_simple_body(t, 1, count_expanded, arg) != 0);
+    --e->tokens;  // nb. the body's own EOF
+  } else {
+    ++e->tokens;
+  }
+}
+
+// checks that a preparse (with its bodies parsed later) agrees with a full parse on each file, as
+// the preparse mode is otherwise timing something else, returns the number that differ
+static int check_preparse(corpus *c) {
+  int differ = 0;
+  for (int i = 0; i < c->count; ++i) {
+    int64_t full = 0;
+    tokendef td = prsr_init_token(c->buf[i]);
+    int full_ret = prsr_simple(&td, 0, count_token, &full);
+
+    expanded e = {0};
+    tokendef lazy_td = prsr_init_token(c->buf[i]);
+    simpledef sd;
+    prsr_simple_init(&sd, &lazy_td, 0, count_expanded, &e);
+    sd.preparse = 1;
+    int lazy_ret = prsr_simple_run(&sd, 0);
+
+    if (full_ret != lazy_ret || e.errors || full != e.tokens) {
+      fprintf(stderr, "preparse differs from a full parse: %s (ret=%d/%d tokens=%lld/%lld)\n",
+          c->path[i], full_ret, lazy_ret, (long long) full, (long long) e.tokens);
+      ++differ;
+    }
+  }
+  return differ;
+}
+
+// runs mode over the whole corpus once, returns ns taken
+static uint64_t run_once(corpus *c, int mode, int64_t *tokens) {
+  if (mode == MODE__INTERN) {
+    prsr_intern_init(&(c->intern), c->slots, c->slots_size);
+  }
+  uint64_t start = now_ns();
+  for (int i = 0; i < c->count; ++i) {
+    if (mode == MODE__PARSE && c->json) {
+      prsr_json(c->buf[i], count_token, tokens);
+      continue;
+    } else if (mode != MODE__TOKENIZE) {
+      tokendef td = prsr_init_token(c->buf[i]);
+      if (mode == MODE__INTERN) {
+        td.intern = &(c->intern);
+      } else if (mode == MODE__STRINGS) {
+        int max = c->len[i] / 2 + 1;
+        prsr_strings_init(&(c->strings), c->strings_data, c->len[i], c->strings_all, max);
+        td.strings = &(c->strings);
+      } else if (mode == MODE__NUMBERS) {
+        prsr_numbers_init(&(c->numbers), c->numbers_all, c->len[i] / 2 + 1);
+        td.numbers = &(c->numbers);
+      }
+      simpledef sd;
+      prsr_simple_init(&sd, &td, 0, count_token, tokens);
+      sd.preparse = (mode == MODE__PREPARSE);
+      prsr_simple_run(&sd, 0);
+      continue;
+    }
+
+    benchlex l;
+    benchlex_init(&l, c->buf[i]);
+    token out;
+    while (l.td.next.type) {
+      benchlex_next(&l, &out);  // nb. errors still consume a token
+      ++*tokens;
+    }
+  }
+  return now_ns() - start;
+}
+
+static int compare_ns(const void *a, const void *b) {
+  uint64_t x = *(uint64_t *) a, y = *(uint64_t *) b;
+  return (x > y) - (x < y);
+}
+
+// runs mode many times, counting over all of the timed runs if perf is non-NULL
+static result run_mode(corpus *c, int mode, int runs, perfdef *perf) {
+  result r = {0};
+  int64_t ignored = 0;
+  for (int i = 0; i < WARMUP; ++i) {
+    run_once(c, mode, &ignored);
+  }
+
+  uint64_t *ns = malloc(sizeof(uint64_t) * runs);
+  if (perf) {
+    perf_start(perf);
+  }
+  for (int i = 0; i < runs; ++i) {
+    int64_t tokens = 0;
+    ns[i] = run_once(c, mode, &tokens);
+    r.tokens = tokens;
+  }
+  if (perf) {
+    perf_stop(perf, r.counters);
+    for (int i = 0; i < PERF__COUNT; ++i) {
+      if (r.counters[i] >= 0) {
+        r.counters[i] /= runs;
+      }
+    }
+  }
+  qsort(ns, runs, sizeof(uint64_t), compare_ns);
+
+  int p99 = (runs * 99 + 99) / 100 - 1;  // nearest rank
+  r.median = ns[runs / 2];
+  r.p99 = ns[p99];
+  free(ns);
+  return r;
+}
+
+// reads "<mode> <median> <p99> <bytes>" lines, returns 0 if the baseline has no such mode
+static uint64_t read_baseline(const char *path, const char *mode, int64_t bytes) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    fprintf(stderr, "can't read baseline: %s\n", path);
+    exit(1);
+  }
+
+  char name[16];
+  unsigned long long median, p99;
+  long long base_bytes;
+  uint64_t out = 0;
+  while (fscanf(f, "%15s %llu %llu %lld", name, &median, &p99, &base_bytes) == 4) {
+    if (strcmp(name, mode)) {
+      continue;
+    }
+    if (base_bytes != bytes) {
+      fprintf(stderr, "baseline is for a different corpus (%lld bytes, not %lld)\n",
+          base_bytes, (long long) bytes);
+      exit(1);
+    }
+    out = median;
+  }
+  fclose(f);
+  return out;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "usage: %s [-n runs] [-json] [-perf] [-save file] "
+      "[-compare file [-tolerance pct]] <file>...\n", name);
+  exit(1);
+}
+
+static void print_counters(const char *name, const char *per, result *r, double div) {
+  printf("%-9s %-6s", name, per);
+  for (int i = 0; i < PERF__COUNT; ++i) {
+    if (r->counters[i] < 0) {
+      printf(" %9s", "-");
+    } else {
+      printf(" %9.3f", r->counters[i] / div);
+    }
+  }
+  printf("\n");
+}
+
+int main(int argc, char **argv) {
+  int runs = 20;
+  double tolerance = 5.0;
+  const char *save = NULL;
+  const char *compare = NULL;
+  int use_perf = 0;
+  corpus c = {0};
+  c.buf = malloc(sizeof(char *) * argc);
+  c.len = malloc(sizeof(int) * argc);
+  c.path = malloc(sizeof(char *) * argc);
+
+  for (int i = 1; i < argc; ++i) {
+    char *arg = argv[i];
+    int has_value = (i + 1 < argc);
+    if (!strcmp(arg, "-n") && has_value) {
+      runs = atoi(argv[++i]);
+    } else if (!strcmp(arg, "-json")) {
+      c.json = 1;
+    } else if (!strcmp(arg, "-perf")) {
+      use_perf = 1;
+    } else if (!strcmp(arg, "-save") && has_value) {
+      save = argv[++i];
+    } else if (!strcmp(arg, "-compare") && has_value) {
+      compare = argv[++i];
+    } else if (!strcmp(arg, "-tolerance") && has_value) {
+      tolerance = atof(argv[++i]);
+    } else if (arg[0] == '-') {
+      usage(argv[0]);
+    } else {
+      int len;
+      char *buf = read_file(arg, &len);
+      if (!buf) {
+        fprintf(stderr, "can't read: %s\n", arg);
+        return 1;
+      }
+      c.buf[c.count] = buf;
+      c.path[c.count] = arg;
+      c.len[c.count] = len;
+      c.bytes += len;
+      c.max_len = (len > c.max_len ? len : c.max_len);
+      ++c.count;
+    }
+  }
+  if (!c.count || runs < 1) {
+    usage(argv[0]);
+  }
+
+  // interning and decoding don't apply to JSON, otherwise size the table generously from the corpus
+  int modes = c.json ? MODE__INTERN : MODE__COUNT;
+  for (c.slots_size = 1024; c.slots_size < c.bytes / 32; c.slots_size *= 2);
+  c.slots = malloc(sizeof(prsr_intern_slot) * c.slots_size);
+  c.strings_data = malloc(c.max_len + 1);
+  c.strings_all = malloc(sizeof(prsr_string) * (c.max_len / 2 + 1));
+  c.numbers_all = malloc(sizeof(prsr_number) * (c.max_len / 2 + 1));
+
+  if (!c.json && check_preparse(&c)) {
+    return 1;
+  }
+
+  FILE *out = NULL;
+  if (save && !(out = fopen(save, "w"))) {
+    fprintf(stderr, "can't write baseline: %s\n", save);
+    return 1;
+  }
+
+  perfdef perf;
+  if (use_perf && perf_open(&perf) < PERF__COUNT) {
+    fprintf(stderr, "perf: some counters unavailable (%s), see /proc/sys/kernel/perf_event_paranoid\n",
+        perf_error(&perf));
+  }
+
+  printf("kernel=%s files=%d bytes=%lld runs=%d\n",
+      prsr_scan_kernel(), c.count, (long long) c.bytes, runs);
+  printf("%-9s %9s %9s %9s %11s", "mode", "MB/s", "median", "p99", "Mtokens/s");
+  if (compare) {
+    printf(" %9s", "baseline");
+  }
+  printf("\n");
+
+  int regressed = 0;
+  result all[MODE__COUNT];
+  const char *names[MODE__COUNT];
+  for (int mode = 0; mode < modes; ++mode) {
+    const char *name = mode_names[mode];
+    if (mode == MODE__PARSE && c.json) {
+      name = "json";
+    }
+    names[mode] = name;
+
+    result r = run_mode(&c, mode, runs, use_perf ? &perf : NULL);
+    if (mode == MODE__INTERN && c.intern.full) {
+      fprintf(stderr, "intern: table of %d slots is full\n", c.slots_size);
+    }
+    all[mode] = r;
+    printf("%-9s %9.1f %7.2fms %7.2fms %11.2f", name,
+        c.bytes * 1e3 / r.median, r.median / 1e6, r.p99 / 1e6, r.tokens * 1e3 / r.median);
+
+    if (compare) {
+      uint64_t base = read_baseline(compare, name, c.bytes);
+      if (base) {
+        double delta = (100.0 * r.median) / base - 100.0;
+        int bad = delta > tolerance;
+        regressed += bad;
+        printf(" %+8.1f%%%s", delta, bad ? " (regressed)" : "");
+      } else {
+        printf(" %9s", "-");
+      }
+    }
+    printf("\n");
+
+    if (out) {
+      fprintf(out, "%s %llu %llu %lld\n", name,
+          (unsigned long long) r.median, (unsigned long long) r.p99, (long long) c.bytes);
+    }
+  }
+
+  if (use_perf) {
+    printf("\n%-16s", "counters");
+    for (int i = 0; i < PERF__COUNT; ++i) {
+      printf(" %9s", perf_names[i]);
+    }
+    printf("\n");
+    for (int mode = 0; mode < modes; ++mode) {
+      print_counters(names[mode], "/byte", &all[mode], c.bytes);
+      print_counters(names[mode], "/token", &all[mode], all[mode].tokens);
+    }
+    perf_close(&perf);
+  }
+
+  if (out) {
+    fclose(out);
+  }
+  if (regressed) {
+    printf("%d mode(s) slower than baseline by over %.1f%%\n", regressed, tolerance);
+  }
+  return regressed ? 1 : 0;
+}
@@ -0,0 +1,1027 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+// Generates valid JavaScript of a given size and profile. The same seed gives the same output on
+// any machine, so benchmarks can share inputs without shipping real sources.
+// usage: ./bench/run.sh gen [-profile name] [-size 1M] [-seed n] [-o file] [-check]
+
+#include "../parser.h"
+#include <ctype.h>
+#include <string.h>
+#include "util.h"
+
+typedef struct {
+  const char *name;
+  int pretty;        // newlines and indentation, else minified
+  int max_depth;     // nesting of blocks and expressions
+  int comment_pct;   // chance of a comment before each statement
+  int template_pct;  // chance that a string is a template literal
+  int asi_pct;       // chance that a semicolon is left to ASI (pretty only)
+  int module;        // imports and exports
+} genprofile;
+
+static const genprofile profiles[] = {
+  {"minified", 0, 6, 0, 5, 0, 0},
+  {"module", 1, 5, 5, 5, 25, 1},
+  {"comments", 1, 4, 60, 5, 0, 0},
+  {"templates", 1, 5, 5, 60, 0, 1},
+  {"nested", 1, 32, 0, 10, 0, 0},
+};
+#define PROFILE_COUNT ((int) (sizeof(profiles) / sizeof(genprofile)))
+
+#define ITEM_LIMIT 4096  // bytes per top-level item before nesting stops
+
+typedef struct {
+  char *buf;
+  int len;
+  int cap;
+  uint32_t seed;
+  const genprofile *p;
+  int indent;
+  int limit;  // stop nesting once len passes this
+  int names;  // declared so far, so that names never clash
+
+  // where we are, for await, yield, return, break and this
+  uint8_t in_function : 1;
+  uint8_t in_async : 1;
+  uint8_t in_generator : 1;
+  uint8_t in_loop : 1;
+  uint8_t in_method : 1;
+} gendef;
+
+static const char *idents[] = {
+  "value", "items", "index", "result", "node", "options", "config", "data", "el", "count",
+  "user", "key", "cache", "state", "props", "event", "list", "total", "err", "$el", "_next",
+};
+static const char *props[] = {
+  "length", "push", "map", "filter", "then", "id", "type", "children", "style", "forEach",
+  "reduce", "join", "parentNode", "get", "set", "has", "name", "status",
+};
+static const char *classes[] = {"Widget", "Store", "Parser", "Client", "Emitter", "Queue"};
+static const char *words[] = {
+  "the", "value", "is", "loading", "failed", "ready", "update", "render", "request", "cannot",
+  "find", "file", "for", "user", "cached", "pending", "with", "retry",
+};
+static const char *binary_ops[] = {
+  "+", "-", "*", "/", "/", "/", "%", "<", ">", "<=", "===", "!==", "&&", "||", "&", "|", "<<",
+  "in", "instanceof",
+};
+
+#define _count(arr) ((int) (sizeof(arr) / sizeof(arr[0])))
+#define _from(g, arr) (arr[pick(g, _count(arr))])
+
+static uint32_t pick(gendef *g, uint32_t n) {
+  uint32_t x = g->seed;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  g->seed = x;
+  return x % n;
+}
+
+static int chance(gendef *g, int pct) {
+  return (int) pick(g, 100) < pct;
+}
+
+static int is_ident_char(char c) {
+  return isalnum(c) || c == '_' || c == '$';
+}
+
+static void out_len(gendef *g, const char *s, int len) {
+  if (g->len + len + 2 > g->cap) {
+    g->cap = (g->cap + len) * 2;
+    g->buf = realloc(g->buf, g->cap);
+  }
+
+  // don't join words, or make "++", "--", "//", "/*" or regexp flags by accident (mostly when minified)
+  char last = g->len ? g->buf[g->len - 1] : 0;
+  char next = s[0];
+  if (((is_ident_char(last) || last == '/') && is_ident_char(next)) ||
+      ((last == '+' || last == '-') && next == last) ||
+      (last == '/' && (next == '/' || next == '*'))) {
+    g->buf[g->len++] = ' ';
+  }
+
+  memcpy(g->buf + g->len, s, len);
+  g->len += len;
+}
+
+static void out(gendef *g, const char *s) {
+  out_len(g, s, strlen(s));
+}
+
+static void outf(gendef *g, const char *fmt, int v) {
+  char tmp[32];
+  snprintf(tmp, sizeof(tmp), fmt, v);
+  out(g, tmp);
+}
+
+static void named(gendef *g, const char *prefix, int v) {
+  char tmp[64];
+  snprintf(tmp, sizeof(tmp), "%s%d", prefix, v);
+  out(g, tmp);
+}
+
+// declares a new name, as let, const and class don't allow redeclaring one
+static void fresh(gendef *g, const char *prefix) {
+  named(g, prefix, ++g->names);
+}
+
+// space only when pretty
+static void sp(gendef *g) {
+  if (g->p->pretty) {
+    out(g, " ");
+  }
+}
+
+// newline and indent only when pretty
+static void nl(gendef *g) {
+  if (!g->p->pretty) {
+    return;
+  }
+  out(g, "\n");
+  for (int i = 0; i < g->indent; ++i) {
+    out(g, "  ");
+  }
+}
+
+// ";" or, sometimes when pretty, a newline for ASI
+static void semi(gendef *g) {
+  if (!(g->p->pretty && chance(g, g->p->asi_pct))) {
+    out(g, ";");
+  }
+}
+
+static int is_deep(gendef *g, int d) {
+  return d >= g->p->max_depth || g->len > g->limit;
+}
+
+static void expr(gendef *g, int d);
+static void value(gendef *g, int d);
+static void statement(gendef *g, int d);
+static void block(gendef *g, int d);
+
+static void text(gendef *g, int count) {
+  for (int i = 0; i < count; ++i) {
+    if (i) {
+      out(g, " ");
+    }
+    out(g, _from(g, words));
+  }
+}
+
+static void string(gendef *g, int d) {
+  if (!chance(g, g->p->template_pct)) {
+    const char *quote = chance(g, 50) ? "'" : "\"";
+    out(g, quote);
+    text(g, 1 + pick(g, 4));
+    if (chance(g, 10)) {
+      out(g, "\\n");
+    }
+    out(g, quote);
+    return;
+  }
+
+  out(g, "`");
+  text(g, 1 + pick(g, 3));
+  int parts = 1 + pick(g, 3);
+  for (int i = 0; i < parts; ++i) {
+    out(g, " ${");
+    expr(g, d + 1);
+    out(g, "}");
+    if (g->p->pretty && chance(g, 20)) {
+      out(g, "\n");  // templates may span lines
+    }
+    text(g, pick(g, 3));
+  }
+  out(g, "`");
+}
+
+static void number(gendef *g) {
+  switch (pick(g, 5)) {
+    case 0:
+      outf(g, "0x%x", pick(g, 65536));
+      break;
+    case 1:
+      outf(g, "%d.5", pick(g, 100));
+      break;
+    case 2:
+      outf(g, "%de3", 1 + pick(g, 9));
+      break;
+    default:
+      outf(g, "%d", pick(g, 1000));
+  }
+}
+
+static void regexp(gendef *g) {
+  static const char *bodies[] = {"^[a-z]+$", "\\d+(\\.\\d+)?", "[/\\]]", "\\s*,\\s*", "^(?:https?:)?\\/\\/"};
+  static const char *flags[] = {"", "g", "i", "gi"};
+  char tmp[64];
+  snprintf(tmp, sizeof(tmp), "/%s/%s", _from(g, bodies), _from(g, flags));
+  out(g, tmp);  // nb. in one piece, as out() would space out the escaped "\\//"
+}
+
+static void primary(gendef *g, int d) {
+  switch (pick(g, 9)) {
+    case 0:
+    case 1:
+    case 2:
+      out(g, _from(g, idents));
+      break;
+    case 3:
+      number(g);
+      break;
+    case 4:
+      string(g, d);
+      break;
+    case 5:
+      out(g, g->in_method && chance(g, 50) ? "this" : _from(g, idents));
+      out(g, ".");
+      out(g, _from(g, props));
+      break;
+    case 6: {
+      static const char *literals[] = {"true", "false", "null", "undefined"};
+      out(g, _from(g, literals));
+      break;
+    }
+    case 7:
+      regexp(g);
+      break;
+    case 8:
+      // division after ")" is ambiguous to the tokenizer
+      out(g, "(");
+      out(g, _from(g, idents));
+      out(g, ")");
+      sp(g);
+      out(g, "/");
+      sp(g);
+      number(g);
+      break;
+  }
+}
+
+static void args(gendef *g, int d) {
+  out(g, "(");
+  int count = pick(g, 3);
+  for (int i = 0; i < count; ++i) {
+    if (i) {
+      out(g, ",");
+      sp(g);
+    }
+    value(g, d + 1);
+  }
+  out(g, ")");
+}
+
+static void call(gendef *g, int d) {
+  out(g, _from(g, idents));
+  if (chance(g, 50)) {
+    out(g, ".");
+    out(g, _from(g, props));
+  }
+  args(g, d);
+}
+
+static void params(gendef *g) {
+  out(g, "(");
+  int count = pick(g, 3);
+  for (int i = 0; i < count; ++i) {
+    if (i) {
+      out(g, ",");
+      sp(g);
+    }
+    named(g, "p", i);
+    if (chance(g, 20)) {
+      sp(g);
+      out(g, "=");
+      sp(g);
+      number(g);
+    }
+  }
+  out(g, ")");
+}
+
+// runs fn with the function context set (nb. restores context after)
+#define _in_function(g, _async, _generator, _method, fn) \
+{ \
+  gendef prev = *g; \
+  g->in_function = 1; \
+  g->in_async = _async; \
+  g->in_generator = _generator; \
+  g->in_method = _method; \
+  g->in_loop = 0; \
+  fn; \
+  g->in_function = prev.in_function; \
+  g->in_async = prev.in_async; \
+  g->in_generator = prev.in_generator; \
+  g->in_method = prev.in_method; \
+  g->in_loop = prev.in_loop; \
+}
+
+static void arrow(gendef *g, int d) {
+  int is_async = chance(g, 30);
+  if (is_async) {
+    out(g, "async");
+    sp(g);
+  }
+  if (chance(g, 30)) {
+    out(g, _from(g, idents));
+  } else {
+    params(g);
+  }
+  sp(g);
+  out(g, "=>");
+  sp(g);
+  if (chance(g, 50) || is_deep(g, d)) {
+    // nb. parens so that an object isn't read as a block
+    _in_function(g, is_async, 0, g->in_method, {
+      out(g, "(");
+      if (is_async && chance(g, 50)) {
+        out(g, "await");
+        out(g, " ");
+        call(g, d + 1);
+      } else {
+        expr(g, d + 1);
+      }
+      out(g, ")");
+    });
+  } else {
+    _in_function(g, is_async, 0, g->in_method, block(g, d + 1));
+  }
+}
+
+static void object(gendef *g, int d) {
+  out(g, "{");
+  int count = pick(g, 4);
+  for (int i = 0; i < count; ++i) {
+    if (i) {
+      out(g, ",");
+    }
+    sp(g);
+    const char *key = _from(g, props);
+    switch (pick(g, 4)) {
+      case 0:
+        out(g, key);  // shorthand
+        break;
+      case 1:
+        out(g, key);
+        params(g);
+        sp(g);
+        _in_function(g, 0, 0, 1, block(g, d + 1));
+        break;
+      case 2:
+        out(g, "[");
+        out(g, _from(g, idents));
+        out(g, "]:");
+        sp(g);
+        value(g, d + 1);
+        break;
+      default:
+        out(g, key);
+        out(g, ":");
+        sp(g);
+        value(g, d + 1);
+    }
+  }
+  if (count) {
+    sp(g);
+  }
+  out(g, "}");
+}
+
+static void expr(gendef *g, int d) {
+  if (is_deep(g, d)) {
+    primary(g, d);
+    return;
+  }
+
+  switch (pick(g, 14)) {
+    case 0:
+    case 1:
+    case 2: {
+      // nb. "{...} * x" is valid but rare, and confuses the parser inside a dict, so wrap it
+      int start = g->len;
+      expr(g, d + 1);
+      if (g->buf[g->len - 1] == '}') {
+        memmove(g->buf + start + 1, g->buf + start, g->len - start);
+        g->buf[start] = '(';
+        ++g->len;
+        out(g, ")");
+      }
+      sp(g);
+      out(g, _from(g, binary_ops));
+      sp(g);
+      expr(g, d + 1);
+      break;
+    }
+    case 3:
+      expr(g, d + 1);
+      sp(g);
+      out(g, "?");
+      sp(g);
+      expr(g, d + 1);
+      sp(g);
+      out(g, ":");
+      sp(g);
+      expr(g, d + 1);
+      break;
+    case 4:
+      call(g, d);
+      break;
+    case 5:
+      out(g, _from(g, idents));
+      out(g, "[");
+      expr(g, d + 1);
+      out(g, "]");
+      break;
+    case 6:
+      // arrows can't be operands
+      out(g, "(");
+      arrow(g, d);
+      out(g, ")");
+      break;
+    case 7:
+      object(g, d);
+      break;
+    case 8: {
+      out(g, "[");
+      int count = pick(g, 4);
+      for (int i = 0; i < count; ++i) {
+        if (i) {
+          out(g, ",");
+          sp(g);
+        }
+        expr(g, d + 1);
+      }
+      out(g, "]");
+      break;
+    }
+    case 9:
+      out(g, "new");
+      out(g, " ");
+      out(g, _from(g, classes));
+      args(g, d);
+      break;
+    case 10:
+      out(g, "(");
+      expr(g, d + 1);
+      out(g, ")");
+      break;
+    case 11: {
+      static const char *unary[] = {"!", "-", "typeof ", "void "};
+      out(g, _from(g, unary));
+      primary(g, d);
+      break;
+    }
+    case 12:
+      // nb. only await or yield calls, as the parser can't always tell if a regexp may follow
+      if (g->in_async) {
+        out(g, "await");
+        out(g, " ");
+        call(g, d + 1);
+        break;
+      } else if (g->in_generator) {
+        out(g, "(yield");
+        out(g, " ");
+        call(g, d + 1);
+        out(g, ")");
+        break;
+      }
+      // fall-through
+
+    default:
+      primary(g, d);
+  }
+}
+
+// an expression where an unwrapped arrow is allowed, e.g. an initializer or argument
+static void value(gendef *g, int d) {
+  if (!is_deep(g, d) && chance(g, 10)) {
+    arrow(g, d);
+  } else {
+    expr(g, d);
+  }
+}
+
+static void comment(gendef *g) {
+  if (chance(g, 50)) {
+    out(g, "// ");
+    text(g, 2 + pick(g, 8));
+    nl(g);
+    return;
+  }
+
+  out(g, "/**");
+  nl(g);
+  out(g, " * ");
+  text(g, 4 + pick(g, 10));
+  out(g, ".");
+  int tags = pick(g, 3);
+  for (int i = 0; i < tags; ++i) {
+    nl(g);
+    out(g, " * @param {string} ");
+    named(g, "p", i);
+    out(g, " ");
+    text(g, 3);
+  }
+  nl(g);
+  out(g, " */");
+  nl(g);
+}
+
+static void block(gendef *g, int d) {
+  out(g, "{");
+  ++g->indent;
+  int count = is_deep(g, d) ? 0 : 1 + pick(g, 3);
+  for (int i = 0; i < count; ++i) {
+    nl(g);
+    statement(g, d + 1);
+  }
+  --g->indent;
+  if (count) {
+    nl(g);
+  }
+  out(g, "}");
+}
+
+static void function(gendef *g, int d) {
+  int is_async = chance(g, 30);
+  int is_generator = !is_async && chance(g, 15);
+  if (is_async) {
+    out(g, "async");
+    out(g, " ");
+  }
+  out(g, is_generator ? "function*" : "function");
+  out(g, " ");
+  fresh(g, _from(g, idents));
+  params(g);
+  sp(g);
+  _in_function(g, is_async, is_generator, 0, block(g, d + 1));
+}
+
+static void class(gendef *g, int d) {
+  out(g, "class");
+  out(g, " ");
+  fresh(g, _from(g, classes));
+  int extends = chance(g, 50);
+  if (extends) {
+    out(g, " extends ");
+    out(g, _from(g, classes));
+  }
+  sp(g);
+  out(g, "{");
+  ++g->indent;
+
+  nl(g);
+  out(g, "constructor");
+  params(g);
+  sp(g);
+  _in_function(g, 0, 0, 1, {
+    out(g, "{");
+    ++g->indent;
+    if (extends) {
+      nl(g);
+      out(g, "super();");
+    }
+    nl(g);
+    out(g, "this.");
+    out(g, _from(g, props));
+    sp(g);
+    out(g, "=");
+    sp(g);
+    value(g, d + 1);
+    out(g, ";");
+    --g->indent;
+    nl(g);
+    out(g, "}");
+  });
+
+  int methods = pick(g, 4);
+  for (int i = 0; i < methods; ++i) {
+    nl(g);
+    int is_async = 0, is_generator = 0, is_getter = 0;
+    switch (pick(g, 5)) {
+      case 0:
+        out(g, "static ");
+        break;
+      case 1:
+        out(g, "get ");
+        is_getter = 1;
+        break;
+      case 2:
+        out(g, "async ");
+        is_async = 1;
+        break;
+      case 3:
+        out(g, "*");
+        is_generator = 1;
+        break;
+    }
+    named(g, _from(g, props), i);
+    if (is_getter) {
+      out(g, "()");
+    } else {
+      params(g);
+    }
+    sp(g);
+    _in_function(g, is_async, is_generator, 1, block(g, d + 1));
+  }
+
+  --g->indent;
+  nl(g);
+  out(g, "}");
+}
+
+static void declaration(gendef *g, int d) {
+  static const char *kinds[] = {"const", "let", "var"};
+  out(g, _from(g, kinds));
+  out(g, " ");
+  switch (pick(g, 4)) {
+    case 0:
+      out(g, "{");
+      out(g, _from(g, props));
+      out(g, ":");
+      sp(g);
+      fresh(g, _from(g, idents));
+      out(g, ",");
+      sp(g);
+      fresh(g, _from(g, idents));
+      out(g, "}");
+      break;
+    case 1:
+      out(g, "[");
+      fresh(g, _from(g, idents));
+      out(g, ",");
+      sp(g);
+      fresh(g, _from(g, idents));
+      out(g, "]");
+      break;
+    default:
+      fresh(g, _from(g, idents));
+  }
+  sp(g);
+  out(g, "=");
+  sp(g);
+  value(g, d + 1);
+  semi(g);
+}
+
+static void statement(gendef *g, int d) {
+  if (g->p->comment_pct && chance(g, g->p->comment_pct)) {
+    comment(g);
+  }
+
+  // nested profiles prefer statements with blocks
+  int choice = pick(g, 16);
+  if (is_deep(g, d)) {
+    choice = 0;
+  } else if (g->p->max_depth > 8 && chance(g, 60)) {
+    choice = 4 + pick(g, 6);
+  }
+
+  switch (choice) {
+    case 0:
+    case 1:
+      declaration(g, d);
+      break;
+
+    case 2:
+    case 3:
+      out(g, _from(g, idents));
+      if (chance(g, 50)) {
+        sp(g);
+        out(g, "=");
+        sp(g);
+        value(g, d + 1);
+      } else {
+        out(g, ".");
+        out(g, _from(g, props));
+        args(g, d);
+      }
+      semi(g);
+      break;
+
+    case 4:
+      out(g, "if");
+      sp(g);
+      out(g, "(");
+      expr(g, d + 1);
+      out(g, ")");
+      sp(g);
+      block(g, d + 1);
+      if (chance(g, 40)) {
+        sp(g);
+        out(g, "else");
+        sp(g);
+        block(g, d + 1);
+      }
+      break;
+
+    case 5: {
+      out(g, "for");
+      sp(g);
+      if (chance(g, 50)) {
+        out(g, "(let i = 0; i < ");
+        out(g, _from(g, idents));
+        out(g, ".length; ++i)");
+      } else {
+        out(g, "(const ");
+        out(g, _from(g, idents));
+        out(g, " of ");
+        out(g, _from(g, idents));
+        out(g, ")");
+      }
+      sp(g);
+      int was_loop = g->in_loop;
+      g->in_loop = 1;
+      block(g, d + 1);
+      g->in_loop = was_loop;
+      break;
+    }
+
+    case 6:
+      function(g, d);
+      break;
+
+    case 7:
+      class(g, d);
+      break;
+
+    case 8:
+      out(g, "try");
+      sp(g);
+      block(g, d + 1);
+      sp(g);
+      out(g, "catch");
+      sp(g);
+      out(g, "(err)");
+      sp(g);
+      block(g, d + 1);
+      if (chance(g, 30)) {
+        sp(g);
+        out(g, "finally");
+        sp(g);
+        block(g, d + 1);
+      }
+      break;
+
+    case 9: {
+      // labelled loop with a labelled break
+      int label = ++g->names;
+      named(g, "outer", label);
+      out(g, ":");
+      sp(g);
+      out(g, "while");
+      sp(g);
+      out(g, "(");
+      expr(g, d + 1);
+      out(g, ")");
+      sp(g);
+      out(g, "{");
+      ++g->indent;
+      nl(g);
+      int was_loop = g->in_loop;
+      g->in_loop = 1;
+      statement(g, d + 1);
+      g->in_loop = was_loop;
+      nl(g);
+      named(g, "break outer", label);
+      out(g, ";");
+      --g->indent;
+      nl(g);
+      out(g, "}");
+      break;
+    }
+
+    case 10:
+      out(g, "switch");
+      sp(g);
+      out(g, "(");
+      out(g, _from(g, idents));
+      out(g, ")");
+      sp(g);
+      out(g, "{");
+      nl(g);
+      out(g, "case ");
+      number(g);
+      out(g, ":");
+      ++g->indent;
+      nl(g);
+      statement(g, d + 1);
+      nl(g);
+      out(g, "break;");
+      --g->indent;
+      nl(g);
+      out(g, "default:");
+      ++g->indent;
+      nl(g);
+      statement(g, d + 1);
+      --g->indent;
+      nl(g);
+      out(g, "}");
+      break;
+
+    case 11:
+      if (g->in_function) {
+        out(g, "return");
+        if (chance(g, 80)) {
+          out(g, " ");
+          expr(g, d + 1);
+        }
+        semi(g);
+        break;
+      }
+      declaration(g, d);
+      break;
+
+    case 12:
+      if (g->in_loop) {
+        out(g, chance(g, 50) ? "continue" : "break");
+        semi(g);
+        break;
+      }
+      // fall-through
+
+    case 13:
+      out(g, "throw new Error(");
+      string(g, d);
+      out(g, ");");
+      break;
+
+    default:
+      if (g->in_async) {
+        out(g, "await");
+        out(g, " ");
+      }
+      out(g, _from(g, idents));
+      args(g, d);
+      semi(g);
+  }
+}
+
+static void imports(gendef *g) {
+  int count = 1 + pick(g, 4);
+  for (int i = 0; i < count; ++i) {
+    out(g, "import");
+    sp(g);
+    switch (pick(g, 3)) {
+      case 0:
+        out(g, "{");
+        out(g, _from(g, classes));
+        out(g, " as ");
+        fresh(g, _from(g, idents));
+        out(g, "}");
+        break;
+      case 1:
+        out(g, "* as ");
+        fresh(g, "ns");
+        break;
+      default:
+        fresh(g, "def");
+    }
+    out(g, " from ");
+    outf(g, "'./module%d.js'", i);
+    out(g, ";");
+    nl(g);
+  }
+}
+
+static void item(gendef *g) {
+  g->limit = g->len + ITEM_LIMIT;
+  if (g->p->max_depth > 8) {
+    g->limit += ITEM_LIMIT * 16;  // allow room to get deep
+  }
+
+  if (g->p->comment_pct && chance(g, g->p->comment_pct)) {
+    comment(g);
+  }
+  if (g->p->module && chance(g, 30)) {
+    out(g, "export");
+    out(g, " ");
+    switch (pick(g, 3)) {
+      case 0:
+        function(g, 0);
+        break;
+      case 1:
+        class(g, 0);
+        break;
+      default:
+        declaration(g, 0);
+    }
+  } else {
+    statement(g, 0);
+  }
+  nl(g);
+}
+
+static int parse_size(const char *s) {
+  char *end;
+  long size = strtol(s, &end, 10);
+  if (*end == 'K' || *end == 'k') {
+    size <<= 10;
+  } else if (*end == 'M' || *end == 'm') {
+    size <<= 20;
+  }
+  return size;
+}
+
+static void count_token(void *arg, token *t) {
+  (void) t;
+  ++*(int *) arg;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "usage: %s [-profile name] [-size 1M] [-seed n] [-o file] [-check]\nprofiles:", name);
+  for (int i = 0; i < PROFILE_COUNT; ++i) {
+    fprintf(stderr, " %s", profiles[i].name);
+  }
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  const genprofile *profile = &profiles[0];
+  int size = 1 << 20;
+  uint32_t seed = 1;
+  const char *path = NULL;
+  int check = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    char *arg = argv[i];
+    int has_value = (i + 1 < argc);
+    if (!strcmp(arg, "-profile") && has_value) {
+      const char *name = argv[++i];
+      profile = NULL;
+      for (int j = 0; j < PROFILE_COUNT; ++j) {
+        if (!strcmp(name, profiles[j].name)) {
+          profile = &profiles[j];
+        }
+      }
+      if (!profile) {
+        usage(argv[0]);
+      }
+    } else if (!strcmp(arg, "-size") && has_value) {
+      size = parse_size(argv[++i]);
+    } else if (!strcmp(arg, "-seed") && has_value) {
+      seed = strtoul(argv[++i], NULL, 10);
+    } else if (!strcmp(arg, "-o") && has_value) {
+      path = argv[++i];
+    } else if (!strcmp(arg, "-check")) {
+      check = 1;
+    } else {
+      usage(argv[0]);
+    }
+  }
+
+  gendef g = {0};
+  g.p = profile;
+  g.seed = seed ? seed : 1;  // xorshift can't start at zero
+  g.cap = size + ITEM_LIMIT * 64;
+  g.buf = malloc(g.cap);
+
+  if (!profile->pretty) {
+    out(&g, "/*! generated by prsr, profile=minified */");
+  }
+  if (profile->module) {
+    imports(&g);
+  }
+  while (g.len < size) {
+    item(&g);
+  }
+  if (profile->pretty) {
+    out(&g, "\n");
+  }
+  g.buf[g.len] = 0;
+
+  FILE *f = path ? fopen(path, "wb") : stdout;
+  if (!f || fwrite(g.buf, 1, g.len, f) != (size_t) g.len) {
+    fprintf(stderr, "can't write: %s\n", path ? path : "stdout");
+    return 1;
+  }
+  if (path) {
+    fclose(f);
+  }
+
+  int ret = 0;
+  if (check) {
+    int tokens = 0;
+    tokendef td = prsr_init_token(g.buf);
+    ret = prsr_simple(&td, profile->module, count_token, &tokens);
+    fprintf(stderr, "%s: %d bytes, %d tokens, ret=%d\n", profile->name, g.len, tokens, ret);
+  }
+  free(g.buf);
+  return ret ? 1 : 0;
+}
@@ -0,0 +1,181 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+// Finds the top-level statements of a file that cost the most to parse, per byte.
+// usage: ./bench/run.sh heatmap [-n top] [-min bytes] [-module] <file.js>
+
+#include "../parser.h"
+#include <string.h>
+#include "../tokens/lit.h"
+#include "util.h"
+
+#define RUNS 5
+
+typedef struct {
+  int start;  // offset of first token
+  int end;    // offset of first token of the next statement
+  int line_no;
+  int tokens;
+  uint64_t cycles;  // best of RUNS
+} stmt;
+
+typedef struct {
+  stmt *all;
+  int count;
+  int cap;
+  int tokens;  // since last boundary
+  int last;    // type of the last token yielded
+} heatmap;
+
+static void count_token(void *arg, token *t) {
+  heatmap *h = (heatmap *) arg;
+  ++h->tokens;
+  h->last = t->type;
+}
+
+// parses buf one step at a time, splitting where each top-level statement ends: back in the
+// top-level block after its ";" (real or ASI) or "}", and not continued by "else", "catch" or
+// "finally" (which the parser also reads from the top-level block)
+static int run(char *buf, int len, int is_module, heatmap *h, int first) {
+  tokendef td = prsr_init_token(buf);
+  simpledef sd;
+  prsr_simple_init(&sd, &td, is_module, count_token, h);
+
+  int at = 0;
+  int ret;
+  int prev = 0;  // offset of the last boundary
+  h->last = 0;
+  uint64_t start = now_cycles();
+  do {
+    ret = prsr_simple_run(&sd, 1);
+    int done = (ret != ERROR__BUDGET);
+    int offset = (done || !sd.tok.p) ? len : sd.tok.p - buf;
+    if (!done) {
+      uint32_t hash = sd.tok.hash;
+      if (sd.curr != sd.stack || (h->last != TOKEN_SEMICOLON && h->last != TOKEN_CLOSE) ||
+          hash == LIT_ELSE || hash == LIT_CATCH || hash == LIT_FINALLY || offset <= prev) {
+        continue;
+      }
+    }
+    prev = offset;
+
+    // reached the end of a statement (or file)
+    uint64_t end = now_cycles();
+    if (first) {
+      if (h->count == h->cap) {
+        h->cap = h->cap ? h->cap * 2 : 1024;
+        h->all = realloc(h->all, sizeof(stmt) * h->cap);
+      }
+      stmt *s = &(h->all[h->count++]);
+      s->start = h->count > 1 ? h->all[h->count - 2].end : 0;
+      s->end = offset;
+      s->line_no = 0;
+      s->tokens = h->tokens;
+      s->cycles = end - start;
+    } else if (at < h->count && end - start < h->all[at].cycles) {
+      h->all[at].cycles = end - start;
+    }
+    ++at;
+    h->tokens = 0;
+    start = now_cycles();
+  } while (ret == ERROR__BUDGET);
+
+  return ret;
+}
+
+static int compare_cost(const void *a, const void *b) {
+  const stmt *x = a, *y = b;
+  double cx = (double) x->cycles / (x->end - x->start + 1);
+  double cy = (double) y->cycles / (y->end - y->start + 1);
+  return (cx < cy) - (cx > cy);
+}
+
+int main(int argc, char **argv) {
+  int top = 20;
+  int min = 64;  // smaller statements are mostly per-step overhead
+  int is_module = 0;
+  const char *path = NULL;
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+      top = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-min") && i + 1 < argc) {
+      min = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-module")) {
+      is_module = 1;
+    } else {
+      path = argv[i];
+    }
+  }
+  if (!path) {
+    fprintf(stderr, "usage: %s [-n top] [-min bytes] [-module] <file.js>\n", argv[0]);
+    return 1;
+  }
+
+  int len;
+  char *buf = read_file(path, &len);
+  if (!buf) {
+    fprintf(stderr, "can't read: %s\n", path);
+    return 1;
+  }
+
+  heatmap h = {0};
+  int ret = run(buf, len, is_module, &h, 1);
+  for (int i = 1; i < RUNS; ++i) {
+    run(buf, len, is_module, &h, 0);
+  }
+
+  // find lines before sorting
+  uint64_t total = 0;
+  int line_no = 1;
+  char *p = buf;
+  for (int i = 0; i < h.count; ++i) {
+    stmt *s = &h.all[i];
+    for (; p < buf + s->start; ++p) {
+      line_no += (*p == '\n');
+    }
+    s->line_no = line_no;
+    total += s->cycles;
+  }
+  qsort(h.all, h.count, sizeof(stmt), compare_cost);
+
+  printf("%d statements, %d bytes, %.2f %s/byte overall, ret=%d\n",
+      h.count, len, (double) total / len, CYCLE_UNIT, ret);
+  printf("%-17s %6s %8s %7s %10s %9s  %s\n",
+      "offset", "line", "bytes", "tokens", CYCLE_UNIT, "per byte", "start");
+  for (int i = 0, shown = 0; i < h.count && shown < top; ++i) {
+    stmt *s = &h.all[i];
+    int bytes = s->end - s->start;
+    if (bytes < min) {
+      continue;
+    }
+    ++shown;
+
+    // show the start of the statement on one line
+    char preview[41];
+    int n = 0;
+    for (char *q = buf + s->start; n < 40 && q < buf + s->end; ++q) {
+      preview[n++] = (*q == '\n' || *q == '\t') ? ' ' : *q;
+    }
+    preview[n] = 0;
+
+    printf("%8d-%-8d %6d %8d %7d %10llu %9.2f  %s\n", s->start, s->end, s->line_no, bytes,
+        s->tokens, (unsigned long long) s->cycles, (double) s->cycles / (bytes ? bytes : 1), preview);
+  }
+
+  free(h.all);
+  free(buf);
+  return 0;
+}
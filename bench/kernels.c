@@ -0,0 +1,257 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+// Drives each tokenizer kernel in isolation over generated input, with and without the index.
+// usage: ./bench/run.sh kernels [kernel]
+
+// included directly to reach its static kernels (run.sh then doesn't link it separately)
+#include "../token.c"
+#include "util.h"
+
+#define RUNS 10
+#define SIZE (1 << 20)
+
+// writes one unit of input for param at p, returns its length
+typedef int (*kernel_fill)(char *p, int param, uint32_t *seed);
+
+// consumes one unit at p, returns the next unit
+typedef char *(*kernel_step)(scanindex *s, char *p);
+
+typedef struct {
+  const char *kernel;
+  const char *param_name;
+  int param;
+  kernel_fill fill;
+  kernel_step step;
+  int uses_index;
+} kernelcase;
+
+static uint32_t next_rand(uint32_t *seed) {
+  uint32_t x = *seed;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return (*seed = x);
+}
+
+static int fill_repeat(char *p, char c, int len) {
+  memset(p, c, len);
+  return len;
+}
+
+static const char *keywords[] = {"function", "return", "const", "typeof", "if", "this", "new", "await"};
+static const char *symbols[] = {"foo", "element", "x", "render", "options", "_cache", "$el", "index"};
+
+// param is the percentage of keywords
+static int fill_words(char *p, int param, uint32_t *seed) {
+  const char **from = (int) (next_rand(seed) % 100) < param ? keywords : symbols;
+  const char *word = from[next_rand(seed) % 8];
+  int len = strlen(word);
+  memcpy(p, word, len);
+  p[len] = ' ';
+  return len + 1;
+}
+
+// param is the identifier length
+static int fill_ident(char *p, int param, uint32_t *seed) {
+  for (int i = 0; i < param; ++i) {
+    p[i] = 'a' + next_rand(seed) % 26;
+  }
+  p[param] = ' ';
+  return param + 1;
+}
+
+// param is the length of whitespace after each byte of code, ending with a newline if over 1
+static int fill_space(char *p, int param, uint32_t *seed) {
+  (void) seed;
+  p[0] = 'x';
+  fill_repeat(p + 1, ' ', param);
+  if (param > 1) {
+    p[param] = '\n';
+  }
+  return param + 1;
+}
+
+// param is the string body length
+static int fill_string(char *p, int param, uint32_t *seed) {
+  (void) seed;
+  p[0] = '\'';
+  fill_repeat(p + 1, 'a', param);
+  p[param + 1] = '\'';
+  p[param + 2] = ' ';
+  return param + 3;
+}
+
+// param is the line comment body length
+static int fill_line_comment(char *p, int param, uint32_t *seed) {
+  (void) seed;
+  memcpy(p, "//", 2);
+  fill_repeat(p + 2, 'c', param);
+  p[param + 2] = '\n';
+  return param + 3;
+}
+
+// param is the block comment body length, with a '*' every 16 bytes
+static int fill_block_comment(char *p, int param, uint32_t *seed) {
+  (void) seed;
+  memcpy(p, "/*", 2);
+  for (int i = 0; i < param; ++i) {
+    p[i + 2] = (i & 15) == 15 ? '*' : 'c';
+  }
+  memcpy(p + param + 2, "*/\n", 3);
+  return param + 5;
+}
+
+// param is the regexp body length, with a class and escape every 16 bytes
+static int fill_regexp(char *p, int param, uint32_t *seed) {
+  (void) seed;
+  p[0] = '/';
+  for (int i = 0; i < param; ++i) {
+    p[i + 1] = "ab[/]c\\/defghijk"[i & 15];
+  }
+  memcpy(p + param + 1, "/g ", 3);
+  return param + 4;
+}
+
+static char *step_space(scanindex *s, char *p) {
+  int line_no = 0;
+  p = consume_space(s, p, &line_no);
+  return p + (*p != 0);
+}
+
+static char *step_string(scanindex *s, char *p) {
+  int line_no = 0, litflag = 0;
+  return p + consume_string(s, p, &line_no, &litflag) + 1;
+}
+
+static char *step_comment(scanindex *s, char *p) {
+  int line_no = 0;
+  return p + consume_comment(s, p, &line_no, 0) + 1;
+}
+
+static char *step_regexp(scanindex *s, char *p) {
+  (void) s;
+  return p + consume_slash_regexp(p) + 1;
+}
+
+static char *step_known_lit(scanindex *s, char *p) {
+  (void) s;
+  uint32_t hash;
+  p += consume_known_lit(p, &hash);
+  while (*p != ' ') {
+    ++p;
+  }
+  return p + 1;
+}
+
+static char *step_eat_token(scanindex *s, char *p) {
+  token prev = {.type = TOKEN_EOF};
+  eat_out out = eat_token(s, p, &prev);
+  return p + out.len + 1;
+}
+
+static const kernelcase cases[] = {
+  {"consume_space", "run", 1, fill_space, step_space, 1},
+  {"consume_space", "run", 4, fill_space, step_space, 1},
+  {"consume_space", "run", 16, fill_space, step_space, 1},
+  {"consume_space", "run", 64, fill_space, step_space, 1},
+  {"consume_string", "len", 8, fill_string, step_string, 1},
+  {"consume_string", "len", 64, fill_string, step_string, 1},
+  {"consume_string", "len", 512, fill_string, step_string, 1},
+  {"consume_comment", "line", 16, fill_line_comment, step_comment, 1},
+  {"consume_comment", "line", 128, fill_line_comment, step_comment, 1},
+  {"consume_comment", "block", 16, fill_block_comment, step_comment, 1},
+  {"consume_comment", "block", 128, fill_block_comment, step_comment, 1},
+  {"consume_slash_regexp", "len", 8, fill_regexp, step_regexp, 0},
+  {"consume_slash_regexp", "len", 64, fill_regexp, step_regexp, 0},
+  {"consume_known_lit", "kw%", 0, fill_words, step_known_lit, 0},
+  {"consume_known_lit", "kw%", 50, fill_words, step_known_lit, 0},
+  {"consume_known_lit", "kw%", 100, fill_words, step_known_lit, 0},
+  {"eat_token", "len", 2, fill_ident, step_eat_token, 1},
+  {"eat_token", "len", 8, fill_ident, step_eat_token, 1},
+  {"eat_token", "len", 32, fill_ident, step_eat_token, 1},
+  {"eat_token", "kw%", 50, fill_words, step_eat_token, 1},
+};
+#define CASE_COUNT ((int) (sizeof(cases) / sizeof(kernelcase)))
+
+// fills buf with whole units (from a fixed seed), returns the length used
+static int generate(char *buf, const kernelcase *c) {
+  uint32_t seed = 0x9e3779b9;
+  int at = 0;
+  for (;;) {
+    char unit[1024];
+    int len = c->fill(unit, c->param, &seed);
+    if (at + len > SIZE) {
+      break;
+    }
+    memcpy(buf + at, unit, len);
+    at += len;
+  }
+  buf[at] = 0;
+  return at;
+}
+
+static double run(char *buf, int len, const kernelcase *c, scan_classify classify) {
+  uint64_t best = UINT64_MAX;
+  for (int i = 0; i < RUNS; ++i) {
+    scanindex s;
+    prsr_scan_init(&s, buf, buf + len);
+    s.classify = classify;
+    char *end = buf + len;
+
+    uint64_t start = now_cycles();
+    for (char *p = buf; p < end;) {
+      p = c->step(&s, p);
+    }
+    uint64_t took = now_cycles() - start;
+    if (took < best) {
+      best = took;
+    }
+  }
+  return (double) best / len;
+}
+
+int main(int argc, char **argv) {
+  const char *only = argc > 1 ? argv[1] : NULL;
+  scan_classify classify = prsr_scan_classifier();
+
+  // block-aligned, so that no block needs a padded copy
+  char *buf = aligned_alloc(64, SIZE + 64);
+
+  printf("kernel=%s\n%-22s %-10s %9s %9s\n", prsr_scan_kernel(), "function", "input", "index", "scalar");
+  for (int i = 0; i < CASE_COUNT; ++i) {
+    const kernelcase *c = &cases[i];
+    if (only && strcmp(only, c->kernel)) {
+      continue;
+    }
+
+    int len = generate(buf, c);
+    char input[32];
+    snprintf(input, sizeof(input), "%s=%d", c->param_name, c->param);
+
+    printf("%-22s %-10s ", c->kernel, input);
+    if (c->uses_index && classify) {
+      printf("%9.3f ", run(buf, len, c, classify));
+    } else {
+      printf("%9s ", "-");
+    }
+    printf("%9.3f\n", run(buf, len, c, NULL));
+  }
+
+  printf("%s/byte, best of %d over %dKB\n", CYCLE_UNIT, RUNS, SIZE >> 10);
+  free(buf);
+  return 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+// Tokenizes without a parser for benchmarks, guessing whether each slash is a divide from the token
+// before it (as prsr_module_scan does), so division isn't lexed as a regexp. Not part of prsr itself.
+
+#ifndef _BENCH_LEX_H
+#define _BENCH_LEX_H
+
+#include "../token.h"
+#include "../tokens/lit.h"
+
+typedef struct {
+  tokendef td;
+  token prev;  // previous token (not comment)
+
+  // whether each open group ends a value once closed
+  uint8_t value_close[__STACK_SIZE];
+} benchlex;
+
+static inline void benchlex_init(benchlex *l, char *buf) {
+  l->td = prsr_init_token(buf);
+  l->prev.type = 0;
+}
+
+// is a slash after the previous token a divide (and not a regexp)
+static inline int benchlex_has_value(benchlex *l) {
+  token *t = &(l->prev);
+  switch (t->type) {
+    case TOKEN_LIT:
+      return !(t->hash & _MASK_KEYWORD);
+    case TOKEN_CLOSE:
+      return l->value_close[l->td.depth];
+    case TOKEN_STRING:
+    case TOKEN_NUMBER:
+    case TOKEN_REGEXP:
+      return 1;
+  }
+  return 0;
+}
+
+// reads the next token into out, returns as prsr_next_token (nb. errors still consume a token)
+static inline int benchlex_next(benchlex *l, token *out) {
+  int ret = prsr_next_token(&(l->td), out, benchlex_has_value(l));
+  if (out->type == TOKEN_COMMENT) {
+    return ret;
+  }
+
+  uint8_t *close = l->value_close + l->td.depth;
+  token *prev = &(l->prev);
+  switch (out->type) {
+    case TOKEN_PAREN:
+      close[-1] = !(prev->type == TOKEN_LIT && (prev->hash & _MASK_CONTROL_PAREN));
+      break;
+    case TOKEN_BRACE:
+      // a dict after an op or open, otherwise a block
+      close[-1] = (prev->type == TOKEN_OP || prev->type == TOKEN_COLON || prev->type == TOKEN_PAREN ||
+          prev->type == TOKEN_ARRAY || prev->type == TOKEN_T_BRACE || prev->type == TOKEN_TERNARY ||
+          (prev->type == TOKEN_LIT && (prev->hash == LIT_RETURN ||
+          (prev->hash & (_MASK_UNARY_OP | _MASK_REL_OP)))));
+      break;
+    case TOKEN_ARRAY:
+      close[-1] = 1;
+      break;
+    case TOKEN_T_BRACE:
+    case TOKEN_TERNARY:
+      close[-1] = 0;
+      break;
+  }
+  *prev = *out;
+  return ret;
+}
+
+#endif//_BENCH_LEX_H
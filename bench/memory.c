@@ -0,0 +1,276 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+// Reports the memory each output mode retains, and the peak RSS of parsing with it.
+// usage: ./bench/run.sh memory [-module] [-save file] [-compare file [-tolerance pct]] <file.js>
+
+#include "../parser.h"
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "util.h"
+
+// run.sh only links the root sources, so include the stream encoder directly
+#include "../native/stream.c"
+
+#define MODE__CALLBACK 0  // tokens are counted, then dropped
+#define MODE__TOKENS   1  // every token is copied into an array
+#define MODE__PACKED   2  // tokens are copied as offsets into the source
+#define MODE__STREAM   3  // tokens are encoded by stream_write
+#define MODE__COUNT    4
+
+static const char *mode_names[] = {"callback", "tokens", "packed", "stream"};
+
+// A token without its pointer or hash (which can be found again from the source).
+typedef struct {
+  uint32_t offset;
+  uint32_t len;
+  uint32_t line_no : 24;
+  uint32_t type : 5;
+  uint32_t mark : 3;
+} packed;
+
+typedef struct {
+  char *buf;
+  void *all;
+  int count;
+  int cap;
+  int size;  // of each record, or zero to only count
+} collector;
+
+typedef struct {
+  int ret;
+  int tokens;
+  int64_t retained;  // bytes held once the parse is done, excluding the source
+  int64_t base_kb;   // peak RSS before parsing
+  int64_t peak_kb;   // peak RSS after parsing
+} result;
+
+static void collect(void *arg, token *t) {
+  collector *c = (collector *) arg;
+  if (!c->size) {
+    ++c->count;
+    return;
+  }
+  if (c->count == c->cap) {
+    c->cap = c->cap ? c->cap * 2 : 4096;
+    c->all = realloc(c->all, c->size * c->cap);
+  }
+
+  if (c->size == sizeof(token)) {
+    ((token *) c->all)[c->count++] = *t;
+    return;
+  }
+  packed *p = &((packed *) c->all)[c->count++];
+  p->offset = t->p ? t->p - c->buf : 0;
+  p->len = t->len;
+  p->line_no = t->line_no;
+  p->type = t->type;
+  p->mark = t->mark;
+}
+
+static int64_t peak_kb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;  // bytes on macOS
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+// parses in this process, so peak RSS is only what this mode needed
+static result run_mode(char *buf, int is_module, int mode) {
+  static const int sizes[] = {0, sizeof(token), sizeof(packed), 0};
+  collector c = {.buf = buf, .size = sizes[mode]};
+  result r = {0};
+  r.base_kb = peak_kb();
+
+  tokendef td = prsr_init_token(buf);
+  if (mode == MODE__STREAM) {
+    streamwriter w;
+    stream_writer_init(&w, buf);
+    r.ret = prsr_simple(&td, is_module, stream_write, &w);
+    r.tokens = w.count;
+    r.retained = sizeof(streamheader) + w.size;
+    r.peak_kb = peak_kb();
+    stream_writer_free(&w);
+    return r;
+  }
+
+  r.ret = prsr_simple(&td, is_module, collect, &c);
+  r.tokens = c.count;
+  r.retained = (int64_t) c.size * c.count;
+  r.peak_kb = peak_kb();
+
+  free(c.all);
+  return r;
+}
+
+// runs mode in a child, so that earlier modes don't raise its peak RSS
+static int run_child(char *buf, int is_module, int mode, result *r) {
+  int fd[2];
+  if (pipe(fd)) {
+    return -1;
+  }
+  pid_t pid = fork();
+  if (pid < 0) {
+    return -1;
+  } else if (!pid) {
+    close(fd[0]);
+    result out = run_mode(buf, is_module, mode);
+    _exit(write(fd[1], &out, sizeof(out)) == sizeof(out) ? 0 : 1);
+  }
+
+  close(fd[1]);
+  int ok = (read(fd[0], r, sizeof(result)) == sizeof(result));
+  close(fd[0]);
+  int status;
+  waitpid(pid, &status, 0);
+  return (ok && WIFEXITED(status) && !WEXITSTATUS(status)) ? 0 : -1;
+}
+
+// reads "<mode> <retained> <peak_kb> <bytes>" lines, returns 0 if the baseline has no such mode
+static int read_baseline(const char *path, const char *mode, int64_t bytes, result *out) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    fprintf(stderr, "can't read baseline: %s\n", path);
+    exit(1);
+  }
+
+  char name[16];
+  long long retained, peak, base_bytes;
+  int found = 0;
+  while (fscanf(f, "%15s %lld %lld %lld", name, &retained, &peak, &base_bytes) == 4) {
+    if (strcmp(name, mode)) {
+      continue;
+    }
+    if (base_bytes != bytes) {
+      fprintf(stderr, "baseline is for a different file (%lld bytes, not %lld)\n",
+          base_bytes, (long long) bytes);
+      exit(1);
+    }
+    out->retained = retained;
+    out->peak_kb = peak;
+    found = 1;
+  }
+  fclose(f);
+  return found;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "usage: %s [-module] [-save file] [-compare file [-tolerance pct]] <file.js>\n",
+      name);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  int is_module = 0;
+  double tolerance = 5.0;
+  const char *save = NULL;
+  const char *compare = NULL;
+  const char *path = NULL;
+
+  for (int i = 1; i < argc; ++i) {
+    char *arg = argv[i];
+    int has_value = (i + 1 < argc);
+    if (!strcmp(arg, "-module")) {
+      is_module = 1;
+    } else if (!strcmp(arg, "-save") && has_value) {
+      save = argv[++i];
+    } else if (!strcmp(arg, "-compare") && has_value) {
+      compare = argv[++i];
+    } else if (!strcmp(arg, "-tolerance") && has_value) {
+      tolerance = atof(argv[++i]);
+    } else if (arg[0] == '-' || path) {
+      usage(argv[0]);
+    } else {
+      path = arg;
+    }
+  }
+  if (!path) {
+    usage(argv[0]);
+  }
+
+  int len;
+  char *buf = read_file(path, &len);
+  if (!buf) {
+    fprintf(stderr, "can't read: %s\n", path);
+    return 1;
+  }
+
+  FILE *out = NULL;
+  if (save && !(out = fopen(save, "w"))) {
+    fprintf(stderr, "can't write baseline: %s\n", save);
+    return 1;
+  }
+
+  // state needed by any parse, regardless of mode
+  printf("bytes=%d sizeof: token=%zu packed=%zu tokendef=%zu simpledef=%zu (sstack=%zu x %d)\n",
+      len, sizeof(token), sizeof(packed), sizeof(tokendef), sizeof(simpledef), sizeof(sstack),
+      __STACK_SIZE);
+  printf("%-9s %8s %12s %9s %10s %10s %10s", "mode", "tokens", "retained", "per byte",
+      "per token", "peak RSS", "RSS added");
+  if (compare) {
+    printf(" %9s", "baseline");
+  }
+  printf("\n");
+
+  int regressed = 0;
+  for (int mode = 0; mode < MODE__COUNT; ++mode) {
+    const char *name = mode_names[mode];
+    result r;
+    if (run_child(buf, is_module, mode, &r)) {
+      fprintf(stderr, "%s: child failed\n", name);
+      return 1;
+    }
+    printf("%-9s %8d %12lld %9.3f %10.2f %8lldKB %8lldKB", name, r.tokens,
+        (long long) r.retained, (double) r.retained / len, (double) r.retained / (r.tokens ? r.tokens : 1),
+        (long long) r.peak_kb, (long long) (r.peak_kb - r.base_kb));
+
+    if (compare) {
+      result base;
+      if (read_baseline(compare, name, len, &base)) {
+        // retained is exact, but peak RSS moves with the allocator
+        double delta = base.peak_kb ? (100.0 * r.peak_kb) / base.peak_kb - 100.0 : 0.0;
+        int bad = (r.retained > base.retained) || delta > tolerance;
+        regressed += bad;
+        printf(" %+8.1f%%%s", delta, bad ? " (regressed)" : "");
+      } else {
+        printf(" %9s", "-");
+      }
+    }
+    printf("\n");
+
+    if (r.ret) {
+      fprintf(stderr, "%s: parse returned %d\n", name, r.ret);
+    }
+    if (out) {
+      fprintf(out, "%s %lld %lld %d\n", name, (long long) r.retained, (long long) r.peak_kb, len);
+    }
+  }
+
+  if (out) {
+    fclose(out);
+  }
+  free(buf);
+  if (regressed) {
+    printf("%d mode(s) use more memory than baseline (peak RSS by over %.1f%%)\n",
+        regressed, tolerance);
+  }
+  return regressed ? 1 : 0;
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+// Compares prsr_module_scan against finding the same specifiers with a full parse.
+// usage: ./bench/run.sh modules [-n runs] [-print] [-check] <file>...
+//   e.g. ./bench/run.sh modules -check $(find node_modules -name '*.js')
+
+#include "../parser.h"
+#include "../module.h"
+#include <string.h>
+#include "util.h"
+
+typedef struct {
+  char *buf;
+  uint32_t *all;  // offsets of specifiers, in order
+  int count;
+  int cap;
+  int refs[5];  // by MODULE__ type
+} found;
+
+static void add_offset(found *f, uint32_t offset) {
+  if (f->count && f->all[f->count - 1] == offset) {
+    return;  // names of the same statement
+  }
+  if (f->count == f->cap) {
+    f->cap = f->cap ? f->cap * 2 : 64;
+    f->all = realloc(f->all, sizeof(uint32_t) * f->cap);
+  }
+  f->all[f->count++] = offset;
+}
+
+static int print_refs;
+
+static void module_ref(void *arg, prsr_module_ref *r) {
+  found *f = (found *) arg;
+  ++f->refs[r->type];
+  if (r->specifier.len) {
+    add_offset(f, r->specifier.p - f->buf);
+  }
+  if (print_refs) {
+    printf("%d %u %.*s %.*s %.*s\n", r->type, r->offset, r->specifier.len, r->specifier.p,
+        r->name.len, r->name.p, r->local.len, r->local.p);
+  }
+}
+
+// finds specifiers in the tokens of a full parse: "import 'x'", "from 'x'" and "require('x')"
+typedef struct {
+  found *f;
+  token last[3];  // most recent first
+} matcher;
+
+static int is_lit(token *t, const char *s) {
+  int len = strlen(s);
+  return t->len == len && !memcmp(t->p, s, len);
+}
+
+static void full_token(void *arg, token *t) {
+  matcher *m = (matcher *) arg;
+  if (t->type == TOKEN_COMMENT) {
+    return;
+  }
+
+  token *a = &(m->last[0]);
+  token *b = &(m->last[1]);
+  token *c = &(m->last[2]);
+  if (t->type == TOKEN_STRING && a->type == TOKEN_KEYWORD && (is_lit(a, "from") || is_lit(a, "import"))) {
+    add_offset(m->f, t->p - m->f->buf);
+  } else if ((t->type == TOKEN_CLOSE || (t->type == TOKEN_OP && is_lit(t, ","))) &&
+      a->type == TOKEN_STRING && a->len >= 2 && a->p[0] == a->p[a->len - 1] &&
+      b->type == TOKEN_PAREN && (is_lit(c, "import") || is_lit(c, "require"))) {
+    add_offset(m->f, a->p - m->f->buf);
+  }
+
+  // drop "x.require" and "function require"
+  memmove(m->last + 1, m->last, sizeof(token) * 2);
+  m->last[0] = *t;
+  if (t->type == TOKEN_SYMBOL && is_lit(t, "require") &&
+      ((b = &(m->last[1]))->type == TOKEN_OP || b->type == TOKEN_KEYWORD) &&
+      (is_lit(b, ".") || is_lit(b, "?.") || is_lit(b, "function"))) {
+    m->last[0].type = TOKEN_KEYWORD;
+  }
+}
+
+int main(int argc, char **argv) {
+  int runs = 5;
+  int check = 0;
+  int count = 0;
+  char **paths = malloc(sizeof(char *) * argc);
+
+  for (int i = 1; i < argc; ++i) {
+    char *arg = argv[i];
+    if (!strcmp(arg, "-n") && i + 1 < argc) {
+      runs = atoi(argv[++i]);
+    } else if (!strcmp(arg, "-print")) {
+      print_refs = 1;
+    } else if (!strcmp(arg, "-check")) {
+      check = 1;
+    } else if (arg[0] == '-') {
+      count = 0;
+      break;
+    } else {
+      paths[count++] = arg;
+    }
+  }
+  if (!count || runs < 1) {
+    fprintf(stderr, "usage: %s [-n runs] [-print] [-check] <file>...\n", argv[0]);
+    return 1;
+  }
+
+  char **bufs = malloc(sizeof(char *) * count);
+  int *is_module = malloc(sizeof(int) * count);
+  int64_t bytes = 0;
+  for (int i = 0; i < count; ++i) {
+    int len;
+    if (!(bufs[i] = read_file(paths[i], &len))) {
+      fprintf(stderr, "can't read: %s\n", paths[i]);
+      return 1;
+    }
+    bytes += len;
+  }
+
+  // scan once to count, and to choose which files to fully parse as modules
+  found total = {0};
+  int scan_errors = 0;
+  int parse_errors = 0;
+  int mismatches = 0;
+  for (int i = 0; i < count; ++i) {
+    found f = {.buf = bufs[i]};
+    if (print_refs) {
+      printf("# %s\n", paths[i]);
+    }
+    scan_errors += (prsr_module_scan(bufs[i], module_ref, &f) != 0);
+    is_module[i] = (f.refs[MODULE__IMPORT] || f.refs[MODULE__EXPORT]);
+    for (int j = 0; j < 5; ++j) {
+      total.refs[j] += f.refs[j];
+    }
+    total.count += f.count;
+
+    if (check) {
+      found full = {.buf = bufs[i]};
+      matcher m = {.f = &full};
+      tokendef td = prsr_init_token(bufs[i]);
+      if (prsr_simple(&td, is_module[i], full_token, &m)) {
+        ++parse_errors;  // nb. compared anyway
+      }
+      if (full.count != f.count || memcmp(full.all, f.all, sizeof(uint32_t) * f.count)) {
+        ++mismatches;
+        printf("mismatch: %s (scan=%d full=%d)\n", paths[i], f.count, full.count);
+      }
+      free(full.all);
+    }
+    free(f.all);
+  }
+
+  // time both over every file, best of runs
+  uint64_t best_scan = ~0ULL;
+  uint64_t best_full = ~0ULL;
+  for (int r = 0; r < runs; ++r) {
+    uint64_t start = now_ns();
+    for (int i = 0; i < count; ++i) {
+      found f = {.buf = bufs[i]};
+      prsr_module_scan(bufs[i], module_ref, &f);
+      free(f.all);
+    }
+    uint64_t took = now_ns() - start;
+    best_scan = took < best_scan ? took : best_scan;
+
+    start = now_ns();
+    for (int i = 0; i < count; ++i) {
+      found f = {.buf = bufs[i]};
+      matcher m = {.f = &f};
+      tokendef td = prsr_init_token(bufs[i]);
+      prsr_simple(&td, is_module[i], full_token, &m);
+      free(f.all);
+    }
+    took = now_ns() - start;
+    best_full = took < best_full ? took : best_full;
+  }
+
+  printf("files=%d bytes=%lld specifiers=%d (import=%d export=%d dynamic=%d require=%d refs)\n",
+      count, (long long) bytes, total.count, total.refs[MODULE__IMPORT],
+      total.refs[MODULE__EXPORT], total.refs[MODULE__DYNAMIC], total.refs[MODULE__REQUIRE]);
+  printf("scan  %8.2fms %8.1f MB/s (%d with errors)\n", best_scan / 1e6, bytes * 1e3 / best_scan,
+      scan_errors);
+  printf("full  %8.2fms %8.1f MB/s\n", best_full / 1e6, bytes * 1e3 / best_full);
+  printf("speedup %.2fx\n", (double) best_full / best_scan);
+  if (check) {
+    printf("check: %d files differ from a full parse (%d failed to parse)\n", mismatches,
+        parse_errors);
+  }
+  return mismatches ? 1 : 0;
+}
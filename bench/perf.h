@@ -0,0 +1,148 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+// Hardware counters for benchmarks via Linux perf_event_open. Each counter is opened on its own,
+// so if the kernel or a VM refuses one (or all), the others still work and missing ones read -1.
+
+#ifndef _BENCH_PERF_H
+#define _BENCH_PERF_H
+
+#include <stdint.h>
+
+#define PERF__CYCLES       0
+#define PERF__INSTRUCTIONS 1
+#define PERF__BRANCH_MISS  2
+#define PERF__L1D_MISS     3
+#define PERF__COUNT        4
+
+static const char *perf_names[] = {"cycles", "instr", "br-miss", "L1D-miss"};
+
+typedef struct {
+  int fd[PERF__COUNT];
+  int error;  // errno of the first counter that failed to open
+} perfdef;
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int perf_open_one(uint32_t type, uint64_t config) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// returns the number of counters opened
+static int perf_open(perfdef *p) {
+  uint64_t l1d = PERF_COUNT_HW_CACHE_L1D |
+      (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  p->fd[PERF__CYCLES] = perf_open_one(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+  p->fd[PERF__INSTRUCTIONS] = perf_open_one(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+  p->fd[PERF__BRANCH_MISS] = perf_open_one(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+  p->fd[PERF__L1D_MISS] = perf_open_one(PERF_TYPE_HW_CACHE, l1d);
+
+  int count = 0;
+  p->error = 0;
+  for (int i = 0; i < PERF__COUNT; ++i) {
+    if (p->fd[i] >= 0) {
+      ++count;
+    } else if (!p->error) {
+      p->error = errno;
+    }
+  }
+  return count;
+}
+
+static void perf_start(perfdef *p) {
+  for (int i = 0; i < PERF__COUNT; ++i) {
+    if (p->fd[i] >= 0) {
+      ioctl(p->fd[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(p->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+}
+
+// stops counting and reads each counter into out, or -1 if unavailable
+static void perf_stop(perfdef *p, int64_t out[PERF__COUNT]) {
+  for (int i = 0; i < PERF__COUNT; ++i) {
+    out[i] = -1;
+    if (p->fd[i] < 0) {
+      continue;
+    }
+    ioctl(p->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+    uint64_t v;
+    if (read(p->fd[i], &v, sizeof(v)) == sizeof(v)) {
+      out[i] = v;
+    }
+  }
+}
+
+static void perf_close(perfdef *p) {
+  for (int i = 0; i < PERF__COUNT; ++i) {
+    if (p->fd[i] >= 0) {
+      close(p->fd[i]);
+    }
+  }
+}
+
+static const char *perf_error(perfdef *p) {
+  return p->error ? strerror(p->error) : "ok";
+}
+
+#else
+
+static int perf_open(perfdef *p) {
+  for (int i = 0; i < PERF__COUNT; ++i) {
+    p->fd[i] = -1;
+  }
+  p->error = 0;
+  return 0;
+}
+
+static void perf_start(perfdef *p) {
+  (void) p;
+}
+
+static void perf_stop(perfdef *p, int64_t out[PERF__COUNT]) {
+  (void) p;
+  for (int i = 0; i < PERF__COUNT; ++i) {
+    out[i] = -1;
+  }
+}
+
+static void perf_close(perfdef *p) {
+  (void) p;
+}
+
+static const char *perf_error(perfdef *p) {
+  (void) p;
+  return "perf_event_open is Linux-only";
+}
+
+#endif
+
+#endif//_BENCH_PERF_H
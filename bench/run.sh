@@ -0,0 +1,20 @@
+#!/bin/bash
+# usage: ./bench/run.sh <name> [args...], builds and runs bench/<name>.c
+
+DIR="${BASH_SOURCE%/*}"
+NAME="${1:?usage: $0 <name> [args...]}"
+shift
+
+set -eu
+
+# a bench may #include a source directly to reach its static functions, so don't link it twice
+SOURCES=()
+for SRC in "${DIR}"/../*.c; do
+  if ! grep -q "^#include \"../${SRC##*/}\"" "${DIR}/${NAME}.c"; then
+    SOURCES+=("${SRC}")
+  fi
+done
+
+clang -Ofast -o "${DIR}/_${NAME}" "${SOURCES[@]}" "${DIR}/${NAME}.c"
+"${DIR}/_${NAME}" "$@"
+rm "${DIR}/_${NAME}"
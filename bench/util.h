@@ -0,0 +1,69 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+// Shared helpers for benchmarks. Not part of prsr itself.
+
+#ifndef _BENCH_UTIL_H
+#define _BENCH_UTIL_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static inline uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// reads the TSC (reference cycles at a fixed rate, not core cycles) or falls back to ns
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLE_UNIT "cycles"
+static inline uint64_t now_cycles() {
+  return __rdtsc();
+}
+#else
+#define CYCLE_UNIT "ns"
+static inline uint64_t now_cycles() {
+  return now_ns();
+}
+#endif
+
+// reads path into a NUL-terminated buffer, returns NULL on error
+static inline char *read_file(const char *path, int *len) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    return NULL;
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  rewind(f);
+
+  char *buf = malloc(size + 1);
+  if (fread(buf, 1, size, f) != (size_t) size) {
+    free(buf);
+    fclose(f);
+    return NULL;
+  }
+  fclose(f);
+  buf[size] = 0;
+  *len = size;
+  return buf;
+}
+
+#endif//_BENCH_UTIL_H
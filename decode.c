@@ -0,0 +1,247 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+#include <string.h>
+#include "decode.h"
+
+void prsr_strings_init(prsr_strings *s, char *data, int cap, prsr_string *all, int max) {
+  bzero(s, sizeof(prsr_strings));
+  s->data = data;
+  s->cap = cap;
+  s->all = all;
+  s->max = max;
+}
+
+static inline int hex_value(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  c |= 0x20;  // lowercase
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+
+// reads count hex digits at p, returns -1 if any are invalid
+static int read_hex(char *p, char *end, int count) {
+  if (end - p < count) {
+    return -1;
+  }
+  int out = 0;
+  for (int i = 0; i < count; ++i) {
+    int v = hex_value(p[i]);
+    if (v < 0) {
+      return -1;
+    }
+    out = (out << 4) | v;
+  }
+  return out;
+}
+
+static char *put_utf8(char *out, uint32_t cp) {
+  if (cp < 0x80) {
+    *out++ = cp;
+  } else if (cp < 0x800) {
+    *out++ = 0xc0 | (cp >> 6);
+    *out++ = 0x80 | (cp & 0x3f);
+  } else if (cp < 0x10000) {
+    *out++ = 0xe0 | (cp >> 12);
+    *out++ = 0x80 | ((cp >> 6) & 0x3f);
+    *out++ = 0x80 | (cp & 0x3f);
+  } else {
+    *out++ = 0xf0 | (cp >> 18);
+    *out++ = 0x80 | ((cp >> 12) & 0x3f);
+    *out++ = 0x80 | ((cp >> 6) & 0x3f);
+    *out++ = 0x80 | (cp & 0x3f);
+  }
+  return out;
+}
+
+// reads a \u escape after the "u", returns the code point (or -1 if invalid) and moves *at past it
+static int read_unicode(char **at, char *end) {
+  char *p = *at;
+  if (p < end && *p == '{') {
+    uint32_t cp = 0;
+    int digits = 0;
+    for (++p; p < end && *p != '}'; ++p, ++digits) {
+      int v = hex_value(*p);
+      if (v < 0 || (cp = (cp << 4) | v) > 0x10ffff) {
+        return -1;
+      }
+    }
+    if (p == end || !digits) {
+      return -1;
+    }
+    *at = p + 1;
+    return cp;
+  }
+
+  int cp = read_hex(p, end, 4);
+  if (cp < 0) {
+    return -1;
+  }
+  p += 4;
+
+  // join a surrogate pair written as two escapes
+  if (cp >= 0xd800 && cp < 0xdc00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+    int low = read_hex(p + 2, end, 4);
+    if (low >= 0xdc00 && low < 0xe000) {
+      cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+      p += 6;
+    }
+  }
+  *at = p;
+  return cp;
+}
+
+// decodes the escape after a backslash at *at into out, returns the new out
+static char *decode_escape(char **at, char *end, char *out) {
+  char *p = *at;
+  char c = *p++;
+  int cp;
+
+  switch (c) {
+    case 'n':
+      *out++ = '\n';
+      break;
+    case 't':
+      *out++ = '\t';
+      break;
+    case 'r':
+      *out++ = '\r';
+      break;
+    case 'b':
+      *out++ = '\b';
+      break;
+    case 'f':
+      *out++ = '\f';
+      break;
+    case 'v':
+      *out++ = '\v';
+      break;
+
+    case '\r':
+      if (p < end && *p == '\n') {
+        ++p;
+      }
+      // fall-through
+    case '\n':
+      break;  // line continuation
+
+    case 'x':
+      if ((cp = read_hex(p, end, 2)) < 0) {
+        *out++ = c;  // invalid, keep as-is
+        break;
+      }
+      p += 2;
+      out = put_utf8(out, cp);
+      break;
+
+    case 'u':
+      if ((cp = read_unicode(&p, end)) < 0) {
+        *out++ = c;
+        break;
+      }
+      out = put_utf8(out, cp);
+      break;
+
+    case '0':
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+      // legacy octal (or \0), at most 0377
+      cp = c - '0';
+      for (int i = 0; i < (c < '4' ? 2 : 1) && p < end && *p >= '0' && *p <= '7'; ++i) {
+        cp = (cp << 3) | (*p++ - '0');
+      }
+      out = put_utf8(out, cp);
+      break;
+
+    default:
+      // U+2028 and U+2029 are also line continuations
+      if ((unsigned char) c == 0xe2 && end - p >= 2 && (unsigned char) p[0] == 0x80 &&
+          ((unsigned char) p[1] == 0xa8 || (unsigned char) p[1] == 0xa9)) {
+        p += 2;
+        break;
+      }
+      *out++ = c;  // includes quotes and backslash
+  }
+
+  *at = p;
+  return out;
+}
+
+uint32_t prsr_decode_string(prsr_strings *s, char *p, int len, int resumed) {
+  char quote = resumed ? '`' : p[0];
+  char *start = p + (resumed ? 0 : 1);
+  char *end = p + len;
+
+  // drop the closing quote, unless it's missing or escaped
+  if (end > start && end[-1] == quote) {
+    int slashes = 0;
+    while (end - 2 - slashes >= start && end[-2 - slashes] == '\\') {
+      ++slashes;
+    }
+    if (!(slashes & 1)) {
+      --end;
+    }
+  }
+
+  if (s->count == s->max || s->count == DECODE__MAX_ID ||
+      s->cap - s->size < (uint32_t) (end - start)) {
+    s->full = 1;
+    return 0;
+  }
+  prsr_string *value = &(s->all[s->count++]);
+  value->offset = s->size;
+  char *out = s->data + s->size;
+
+  // copy runs without escapes in bulk, templates also normalize CRLF and CR to LF
+  int is_template = (quote == '`');
+  char *at = start;
+  while (at < end) {
+    char *next = memchr(at, '\\', end - at);
+    if (!next) {
+      next = end;
+    }
+    if (is_template) {
+      char *cr = memchr(at, '\r', next - at);
+      next = cr ? cr : next;
+    }
+    memcpy(out, at, next - at);
+    out += next - at;
+    at = next;
+    if (at == end) {
+      break;
+    }
+
+    if (*at == '\r') {
+      *out++ = '\n';
+      at += (at + 1 < end && at[1] == '\n') ? 2 : 1;
+    } else if (++at < end) {
+      out = decode_escape(&at, end, out);
+    }
+  }
+
+  value->len = out - (s->data + s->size);
+  s->size += value->len;
+  return s->count;
+}
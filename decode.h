@@ -0,0 +1,52 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+#include <stdint.h>
+
+#ifndef _DECODE_H
+#define _DECODE_H
+
+#define DECODE__MAX_ID ((1 << 24) - 1)  // ids must fit in token.id
+
+typedef struct {
+  uint32_t offset;  // into prsr_strings.data
+  uint32_t len;
+} prsr_string;
+
+// Decoded values of string literals and template chunks (as UTF-8, or WTF-8 for lone surrogates),
+// in memory owned by the caller. A value is never longer than its literal, so data of the source's
+// length and one entry per two bytes of source (but at most DECODE__MAX_ID) only run out once ids
+// would no longer fit.
+typedef struct {
+  char *data;
+  uint32_t size;
+  uint32_t cap;
+
+  prsr_string *all;
+  uint32_t count;
+  uint32_t max;
+
+  int full;  // set once out of room, after which values aren't decoded
+} prsr_strings;
+
+// sets up s to decode into data (of cap bytes) and all (of max entries)
+void prsr_strings_init(prsr_strings *s, char *data, int cap, prsr_string *all, int max);
+
+// decodes the string or template chunk of len bytes at p (resumed if it follows a "}" in a
+// template), returns its index in s->all plus one, or zero if s is full
+uint32_t prsr_decode_string(prsr_strings *s, char *p, int len, int resumed);
+
+#endif//_DECODE_H
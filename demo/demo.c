@@ -54,7 +54,6 @@ void render_callback(void *arg, token *out) {
   if (out->type == TOKEN_SEMICOLON && !out->len) {
     ++context->asi;
   }
-#ifndef SPEED
   char c = ' ';
   if (out->hash) {
     c = '#';  // has a hash
@@ -68,7 +67,6 @@ void render_callback(void *arg, token *out) {
     }
   }
   printf("%c%4d.%02d: %.*s\n", c, out->line_no, out->type, out->len, out->p);
-#endif
 }
 
 int main() {
@@ -81,11 +79,28 @@ int main() {
   demo_context context;
   bzero(&context, sizeof(demo_context));
 
+#ifdef JSON
+  int out = prsr_json(buf, render_callback, &context);
+#else
   tokendef td = prsr_init_token(buf);
-  int out = prsr_simple(&td, 1, render_callback, &context);
+  simpledef sd;
+  prsr_simple_init(&sd, &td, 1, render_callback, &context);
+  int out = prsr_simple_run(&sd, 0);
+#endif
   if (out) {
     fprintf(stderr, "ret=%d\n", out);
   }
   fprintf(stderr, ">> %d tokens (%d asi)\n", context.tokens, context.asi);
+#if defined(PRSR_STATS) && !defined(JSON)
+  prsr_stats *s = &sd.stats;
+  fprintf(stderr, ">> %d steps (%d retry), %d slash, %d close_op_next, %d async_resolve, %d virt (%d asi)\n",
+      s->steps, s->retry, s->slash, s->close_op_next, s->async_resolve, s->virt, s->virt_asi);
+  const char *stypes[] = {"expr", "control", "block", "dict", "func", "class", "module", "async"};
+  fprintf(stderr, ">> pushes:");
+  for (int i = 0; i < 8; ++i) {
+    fprintf(stderr, " %s=%d", stypes[i], s->push[i]);
+  }
+  fprintf(stderr, "\n");
+#endif
   return out;
 }
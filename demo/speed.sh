@@ -1,8 +1,10 @@
 #!/bin/bash
+# usage: cat file.js | ./demo/speed.sh [bench args...], see bench/bench.c
 
 cd "${BASH_SOURCE%/*}" || exit
 
 set -eu
-clang -Ofast -o _runner ../*.c demo.c -DSPEED
-time ./_runner
-rm _runner
+INPUT=$(mktemp)
+trap 'rm -f "${INPUT}"' EXIT
+cat > "${INPUT}"
+../bench/run.sh bench "$@" "${INPUT}"
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+#include <string.h>
+#include "intern.h"
+
+#define MUL1 0x9e3779b97f4a7c15ULL
+#define MUL2 0xff51afd7ed558ccdULL
+
+static inline uint64_t rotl(uint64_t v, int by) {
+  return (v << by) | (v >> (64 - by));
+}
+
+void prsr_intern_init(prsr_intern *in, prsr_intern_slot *slots, int size) {
+  bzero(slots, sizeof(prsr_intern_slot) * size);
+  in->slots = slots;
+  in->mask = size - 1;
+  in->count = 0;
+  in->full = 0;
+}
+
+uint64_t prsr_intern_hash(char *p, int len) {
+  uint64_t h = MUL1 ^ ((uint64_t) len * MUL2);
+  int i = 0;
+
+  // most names fit in one or two words
+  for (; i + 8 <= len; i += 8) {
+    uint64_t v;
+    memcpy(&v, p + i, 8);
+    h = rotl(h ^ (v * MUL1), 29) * MUL2;
+  }
+  if (i < len) {
+    uint64_t v = 0;
+    for (int shift = 0; i < len; ++i, shift += 8) {
+      v |= (uint64_t) (unsigned char) p[i] << shift;
+    }
+    h = rotl(h ^ (v * MUL1), 29) * MUL2;
+  }
+
+  h ^= h >> 33;
+  h *= MUL2;
+  h ^= h >> 29;
+  return h ? h : 1;  // zero marks an empty slot
+}
+
+uint32_t prsr_intern_lit(prsr_intern *in, char *p, int len) {
+  uint64_t hash = prsr_intern_hash(p, len);
+  uint32_t at = (uint32_t) hash & in->mask;
+
+  for (;;) {
+    prsr_intern_slot *slot = &(in->slots[at]);
+    if (slot->hash == hash && slot->len == (uint32_t) len && !memcmp(slot->p, p, len)) {
+      return slot->id;
+    } else if (!slot->hash) {
+      break;
+    }
+    at = (at + 1) & in->mask;
+  }
+
+  // keep a quarter of slots empty, so probes stay short
+  if (in->count >= in->mask - (in->mask >> 2) || in->count == INTERN__MAX_ID) {
+    in->full = 1;
+    return 0;
+  }
+  prsr_intern_slot *slot = &(in->slots[at]);
+  slot->hash = hash;
+  slot->p = p;
+  slot->len = len;
+  slot->id = ++in->count;
+  return slot->id;
+}
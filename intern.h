@@ -0,0 +1,51 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+#include <stdint.h>
+
+#ifndef _INTERN_H
+#define _INTERN_H
+
+#define INTERN__MAX_ID ((1 << 24) - 1)  // ids must fit in token.id
+
+typedef struct {
+  uint64_t hash;  // 64-bit hash of the name, or zero if empty
+  char *p;        // first occurrence of the name
+  uint32_t len;
+  uint32_t id;
+} prsr_intern_slot;
+
+// Interns names into slots owned by the caller, handing out dense ids from 1. Names are found by
+// 64-bit hash and then compared byte-for-byte with their first occurrence, so sources must outlive
+// the table. It may be shared between parses, e.g. of files in the same program.
+typedef struct {
+  prsr_intern_slot *slots;
+  uint32_t mask;   // slots - 1
+  uint32_t count;  // ids given out
+  int full;        // set once there was no room, after which new names get id zero
+} prsr_intern;
+
+// sets up in to use size zeroed slots, where size is a power of two (twice the expected number of
+// distinct names is plenty)
+void prsr_intern_init(prsr_intern *in, prsr_intern_slot *slots, int size);
+
+// hashes len bytes at p
+uint64_t prsr_intern_hash(char *p, int len);
+
+// returns the id of the name at p, adding it if new, or zero if in is full
+uint32_t prsr_intern_lit(prsr_intern *in, char *p, int len);
+
+#endif//_INTERN_H
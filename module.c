@@ -0,0 +1,527 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+#include <string.h>
+#include "module.h"
+#include "tokens/lit.h"
+
+#define PATTERN__ENTRY   0  // start of an entry, i.e. a key or binding
+#define PATTERN__BINDING 1  // after ':' or '...'
+#define PATTERN__SKIP    2  // default value or key, until ','
+
+typedef struct {
+  tokendef td;
+  token prev;  // previous token (not comment)
+  token tok;
+  int ret;
+
+  char *buf;
+  prsr_module_callback cb;
+  void *arg;
+
+  // whether each open group ends a value once closed, as there's no parser to resolve slashes
+  uint8_t value_close[__STACK_SIZE];
+
+  prsr_module_ref call;  // call found by prsr_skip_group, yielded once its argument is known
+} moduledef;
+
+// is a slash after t a divide (and not a regexp)
+static int has_value(moduledef *m, token *t) {
+  switch (t->type) {
+    case TOKEN_LIT:
+      return !(t->hash & _MASK_KEYWORD);  // nb. "this", "null" etc aren't keywords here
+    case TOKEN_CLOSE:
+      return m->value_close[m->td.depth];
+    case TOKEN_STRING:
+    case TOKEN_NUMBER:
+    case TOKEN_REGEXP:
+      return 1;
+  }
+  return 0;
+}
+
+// does a "{" after t start a dict (and not a block)
+static int is_dict_after(token *t) {
+  switch (t->type) {
+    case TOKEN_OP:
+    case TOKEN_COLON:
+    case TOKEN_PAREN:
+    case TOKEN_ARRAY:
+    case TOKEN_T_BRACE:
+    case TOKEN_TERNARY:
+      return 1;
+    case TOKEN_LIT:
+      return t->hash == LIT_RETURN || (t->hash & (_MASK_UNARY_OP | _MASK_REL_OP));
+  }
+  return 0;
+}
+
+// is t "." or "?.", so the following name is a property
+static int is_member(token *t) {
+  return t->type == TOKEN_OP && (t->hash == MISC_DOT || (t->len == 2 && t->p[0] == '?'));
+}
+
+static int scan_next(moduledef *m) {
+  if (m->tok.type != TOKEN_COMMENT) {
+    m->prev = m->tok;
+  }
+  do {
+    int ret = prsr_next_token(&(m->td), &(m->tok), has_value(m, &(m->prev)));
+    if (ret && !m->ret) {
+      m->ret = ret;  // nb. errors still consume a token
+    }
+  } while (m->tok.type == TOKEN_COMMENT);
+
+  uint8_t *close = m->value_close + m->td.depth;
+  switch (m->tok.type) {
+    case TOKEN_PAREN:
+      close[-1] = !(m->prev.type == TOKEN_LIT && (m->prev.hash & _MASK_CONTROL_PAREN));
+      break;
+    case TOKEN_BRACE:
+      close[-1] = is_dict_after(&(m->prev));
+      break;
+    case TOKEN_ARRAY:
+      close[-1] = 1;
+      break;
+    case TOKEN_T_BRACE:
+    case TOKEN_TERNARY:
+      close[-1] = 0;  // resumes a template, or ':' wants a value
+      break;
+  }
+  return m->tok.type != TOKEN_EOF;
+}
+
+static inline int next_is(moduledef *m, int type, uint32_t hash) {
+  return m->td.next.type == type && (!hash || m->td.next.hash == hash);
+}
+
+static inline void yield(moduledef *m, prsr_module_ref *ref) {
+  m->cb(m->arg, ref);
+}
+
+// is this string complete, i.e. not a template with parts
+static int is_plain_string(token *t) {
+  return t->type == TOKEN_STRING && t->len >= 2 && t->p[t->len - 1] == t->p[0];
+}
+
+// consumes "from 'x'" into ref, returns 1 if found
+static int scan_from(moduledef *m, prsr_module_ref *ref) {
+  if (!next_is(m, TOKEN_LIT, LIT_FROM)) {
+    return 0;
+  }
+  scan_next(m);
+  if (!next_is(m, TOKEN_STRING, 0)) {
+    return 0;
+  }
+  scan_next(m);
+  ref->specifier = m->tok;
+  return 1;
+}
+
+// consumes "(" and a specifier, after "import" or "require"
+static void scan_call(moduledef *m, int type) {
+  prsr_module_ref ref = {.type = type, .offset = m->tok.p - m->buf};
+  scan_next(m);
+  if (next_is(m, TOKEN_STRING, 0)) {
+    scan_next(m);
+    token *next = &(m->td.next);
+    if (is_plain_string(&(m->tok)) &&
+        (next->type == TOKEN_CLOSE || (next->type == TOKEN_OP && next->hash == MISC_COMMA))) {
+      ref.specifier = m->tok;
+    }
+  }
+  yield(m, &ref);
+}
+
+// matches "import(" or "require(" at the current token, returns 1 if consumed
+static int match_call(moduledef *m) {
+  token *t = &(m->tok);
+  if (t->type != TOKEN_LIT || !next_is(m, TOKEN_PAREN, 0) || is_member(&(m->prev)) ||
+      m->prev.hash == LIT_FUNCTION) {
+    return 0;  // nb. not "x.require(" or "function require("
+  }
+  if (t->hash == LIT_IMPORT) {
+    scan_call(m, MODULE__DYNAMIC);
+  } else if (t->len == 7 && !memcmp(t->p, "require", 7)) {
+    scan_call(m, MODULE__REQUIRE);
+  } else {
+    return 0;
+  }
+  return 1;
+}
+
+// yields any pending call found while skipping
+static void flush_call(moduledef *m) {
+  if (m->call.type) {
+    yield(m, &(m->call));
+    bzero(&(m->call), sizeof(prsr_module_ref));
+  }
+}
+
+static void skip_call(void *arg, token *t) {
+  moduledef *m = (moduledef *) arg;
+  if (t->type == TOKEN_STRING) {
+    if (m->call.type) {
+      m->call.specifier = *t;
+      flush_call(m);
+    }
+    return;
+  }
+
+  flush_call(m);
+  if (t->len == 6 && !memcmp(t->p, "import", 6)) {
+    m->call.type = MODULE__DYNAMIC;
+  } else if (t->len == 7 && !memcmp(t->p, "require", 7)) {
+    m->call.type = MODULE__REQUIRE;
+  } else {
+    return;
+  }
+  m->call.offset = t->p - m->buf;
+}
+
+// skips the rest of the innermost group without tokenizing it (unless it's a ternary), yielding
+// only its calls, so its close is next
+static void skip_group(moduledef *m) {
+  tokendef *td = &(m->td);
+  if (!td->depth || td->stack[td->depth - 1] == TOKEN_TERNARY) {
+    return;
+  }
+  int ret = prsr_skip_group(td, skip_call, m);
+  if (ret && !m->ret) {
+    m->ret = ret;
+  }
+  flush_call(m);
+}
+
+// is t an open that can be skipped
+static inline int is_group(token *t) {
+  switch (t->type) {
+    case TOKEN_PAREN:
+    case TOKEN_BRACE:
+    case TOKEN_ARRAY:
+    case TOKEN_T_BRACE:
+      return 1;
+  }
+  return 0;
+}
+
+// consumes "name" or "name as other" in braces, setting name and local of ref
+static int scan_specifier(moduledef *m, prsr_module_ref *ref) {
+  if (!next_is(m, TOKEN_LIT, 0) && !next_is(m, TOKEN_STRING, 0)) {
+    return 0;
+  }
+  scan_next(m);
+  ref->name = ref->local = m->tok;
+  if (next_is(m, TOKEN_LIT, LIT_AS)) {
+    scan_next(m);
+    scan_next(m);
+    ref->local = m->tok;
+  }
+  return 1;
+}
+
+// consumes "{a, b as c}" of an import or export, yielding each name if ref has a specifier (or
+// there's no need for one), returns 0 if invalid
+static int scan_braces(moduledef *m, prsr_module_ref *ref, int is_export, int emit) {
+  scan_next(m);  // "{"
+  for (;;) {
+    if (next_is(m, TOKEN_CLOSE, 0)) {
+      scan_next(m);
+      return 1;
+    }
+
+    prsr_module_ref each = *ref;
+    if (!scan_specifier(m, &each)) {
+      return 0;
+    }
+    if (is_export) {
+      // "export {a as b}" exports b
+      token t = each.name;
+      each.name = each.local;
+      each.local = t;
+    }
+    each.is_default = (each.name.len == 7 && !memcmp(each.name.p, "default", 7));
+    if (emit) {
+      yield(m, &each);
+    }
+
+    if (next_is(m, TOKEN_OP, MISC_COMMA)) {
+      scan_next(m);
+    } else if (!next_is(m, TOKEN_CLOSE, 0)) {
+      return 0;
+    }
+  }
+}
+
+// consumes the bindings of "import", yielding each one if emit is set, returns 1 if its specifier
+// was found and put into ref
+static int walk_import(moduledef *m, prsr_module_ref *ref, int emit) {
+  if (next_is(m, TOKEN_STRING, 0)) {
+    scan_next(m);
+    ref->specifier = m->tok;
+    if (emit) {
+      yield(m, ref);  // "import 'x'" has no names
+    }
+    return 1;
+  }
+
+  for (;;) {
+    prsr_module_ref each = *ref;
+    token *next = &(m->td.next);
+
+    if (next->type == TOKEN_BRACE) {
+      if (!scan_braces(m, ref, 0, emit)) {
+        return 0;
+      }
+    } else if (next->type == TOKEN_LIT && next->hash == LIT_FROM) {
+      return scan_from(m, ref);
+    } else if (next->type == TOKEN_LIT) {
+      scan_next(m);
+      each.is_default = 1;
+      each.local = m->tok;
+    } else if (next->type == TOKEN_OP && next->hash == MISC_STAR) {
+      scan_next(m);
+      each.name = m->tok;
+      if (!next_is(m, TOKEN_LIT, LIT_AS)) {
+        return 0;
+      }
+      scan_next(m);
+      scan_next(m);
+      each.local = m->tok;
+    } else {
+      return 0;
+    }
+
+    if (each.local.len && emit) {
+      yield(m, &each);
+    }
+    if (next_is(m, TOKEN_OP, MISC_COMMA)) {
+      scan_next(m);
+    }
+  }
+}
+
+// consumes a destructuring pattern (after its open), yielding each binding
+static void walk_pattern(moduledef *m, prsr_module_ref *ref) {
+  int depth = m->td.depth;
+  int is_dict = (m->tok.type == TOKEN_BRACE);
+  int want = PATTERN__ENTRY;
+
+  while (scan_next(m)) {
+    token *t = &(m->tok);
+    int at = m->td.depth;
+    if (match_call(m)) {
+      if (m->td.depth > depth) {
+        skip_group(m);
+      }
+      continue;
+    }
+    if (at < depth) {
+      return;  // closed
+    } else if (at > depth) {
+      if (at == depth + 1 && (t->type == TOKEN_BRACE || t->type == TOKEN_ARRAY) &&
+          (want == PATTERN__BINDING || (want == PATTERN__ENTRY && !is_dict))) {
+        walk_pattern(m, ref);
+        want = PATTERN__SKIP;
+      } else if (is_group(t)) {
+        skip_group(m);  // nb. default values and computed keys
+      }
+      continue;
+    }
+
+    if (t->type == TOKEN_OP && t->hash == MISC_COMMA) {
+      want = PATTERN__ENTRY;
+    } else if (t->type == TOKEN_OP && t->hash == MISC_SPREAD) {
+      want = PATTERN__BINDING;
+    } else if (t->type == TOKEN_COLON) {
+      want = PATTERN__BINDING;
+    } else if (t->type == TOKEN_LIT && want != PATTERN__SKIP) {
+      if (want == PATTERN__ENTRY && is_dict && next_is(m, TOKEN_COLON, 0)) {
+        want = PATTERN__SKIP;  // key
+        continue;
+      }
+      ref->name = ref->local = *t;
+      yield(m, ref);
+      want = PATTERN__SKIP;
+    }
+  }
+}
+
+// consumes the declarations after "var", "let" or "const", yielding each binding, and stops
+// before the end of the statement
+static void walk_decl(moduledef *m, prsr_module_ref *ref) {
+  int depth = m->td.depth;
+  int want = 1;
+
+  for (;;) {
+    token *next = &(m->td.next);
+    if (m->td.depth == depth) {
+      if (!next->type || next->type == TOKEN_SEMICOLON || next->type == TOKEN_CLOSE) {
+        return;
+      }
+
+      // ASI: a name on a new line after a value, which can't continue the expression
+      int after_value = (m->tok.type == TOKEN_CLOSE || has_value(m, &(m->tok)));
+      if (!want && after_value && next->line_no > m->tok.line_no && next->type == TOKEN_LIT &&
+          !(next->hash & _MASK_REL_OP)) {
+        return;
+      }
+    }
+
+    if (!scan_next(m)) {
+      return;
+    } else if (match_call(m)) {
+      if (m->td.depth > depth) {
+        skip_group(m);
+      }
+      continue;
+    }
+    token *t = &(m->tok);
+    if (m->td.depth == depth) {
+      if (want && t->type == TOKEN_LIT) {
+        ref->name = ref->local = *t;
+        yield(m, ref);
+        want = 0;
+      } else if (t->type == TOKEN_OP && t->hash == MISC_COMMA) {
+        want = 1;
+      }
+    } else if (want && m->td.depth == depth + 1 &&
+        (t->type == TOKEN_BRACE || t->type == TOKEN_ARRAY)) {
+      walk_pattern(m, ref);
+      want = 0;
+    } else if (m->td.depth == depth + 1 && is_group(t)) {
+      skip_group(m);
+    }
+  }
+}
+
+// consumes "import" and its bindings (after "import")
+static void scan_import(moduledef *m) {
+  prsr_module_ref ref = {.type = MODULE__IMPORT, .offset = m->tok.p - m->buf};
+
+  // walk twice: once to find the specifier, then again to yield each name with it
+  moduledef start = *m;
+  if (!walk_import(m, &ref, 0)) {
+    return;
+  }
+  *m = start;
+  walk_import(m, &ref, 1);
+}
+
+// consumes "export" and its bindings, but not any function or class body (after "export")
+static void scan_export(moduledef *m) {
+  prsr_module_ref ref = {.type = MODULE__EXPORT, .offset = m->tok.p - m->buf};
+  token *next = &(m->td.next);
+
+  if (next->type == TOKEN_OP && next->hash == MISC_STAR) {
+    // "export * from 'x'" or "export * as y from 'x'"
+    scan_next(m);
+    ref.name = m->tok;
+    if (next_is(m, TOKEN_LIT, LIT_AS)) {
+      ref.local = ref.name;
+      scan_next(m);
+      scan_next(m);
+      ref.name = m->tok;
+    }
+    if (scan_from(m, &ref)) {
+      yield(m, &ref);
+    }
+    return;
+  }
+
+  if (next->type == TOKEN_BRACE) {
+    // find whether this is "export {a} from 'x'", then yield each name
+    moduledef start = *m;
+    if (!scan_braces(m, &ref, 1, 0)) {
+      return;
+    }
+    scan_from(m, &ref);
+    *m = start;
+    scan_braces(m, &ref, 1, 1);
+    if (ref.specifier.len) {
+      scan_from(m, &ref);
+    }
+    return;
+  }
+
+  if (next->type != TOKEN_LIT) {
+    return;
+  }
+  scan_next(m);
+  uint32_t hash = m->tok.hash;
+
+  if (hash == LIT_DEFAULT) {
+    ref.name = m->tok;
+    ref.is_default = 1;
+    if (next_is(m, TOKEN_LIT, LIT_ASYNC)) {
+      scan_next(m);
+    }
+    if (next_is(m, TOKEN_LIT, LIT_FUNCTION) || next_is(m, TOKEN_LIT, LIT_CLASS)) {
+      scan_next(m);
+      hash = m->tok.hash;
+    } else {
+      hash = 0;  // an expression
+    }
+  } else if (hash == LIT_VAR || hash == LIT_LET || hash == LIT_CONST) {
+    walk_decl(m, &ref);
+    return;
+  } else if (hash == LIT_ASYNC && next_is(m, TOKEN_LIT, LIT_FUNCTION)) {
+    scan_next(m);
+    hash = LIT_FUNCTION;
+  }
+
+  // "function* foo" or "class foo", but not "class extends"
+  if (hash == LIT_FUNCTION && next_is(m, TOKEN_OP, MISC_STAR)) {
+    scan_next(m);
+  }
+  if ((hash == LIT_FUNCTION || hash == LIT_CLASS) && next_is(m, TOKEN_LIT, 0) &&
+      m->td.next.hash != LIT_EXTENDS) {
+    scan_next(m);
+    ref.local = m->tok;
+    if (!ref.is_default) {
+      ref.name = m->tok;
+    }
+  }
+  if (ref.name.len) {
+    yield(m, &ref);
+  }
+}
+
+int prsr_module_scan(char *buf, prsr_module_callback cb, void *arg) {
+  moduledef m;
+  bzero(&m, sizeof(moduledef));
+  m.td = prsr_init_token(buf);
+  m.buf = buf;
+  m.cb = cb;
+  m.arg = arg;
+
+  while (scan_next(&m)) {
+    token *t = &(m.tok);
+    if (match_call(&m) || m.td.depth) {
+      skip_group(&m);  // nb. after a call, skips the rest of its arguments
+      continue;
+    } else if (t->type != TOKEN_LIT || is_member(&(m.prev))) {
+      continue;
+    }
+
+    if (t->hash == LIT_IMPORT && !next_is(&m, TOKEN_OP, MISC_DOT)) {
+      scan_import(&m);  // but not "import.meta"
+    } else if (t->hash == LIT_EXPORT) {
+      scan_export(&m);
+    }
+  }
+  return m.ret;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+#include <stdint.h>
+#include "token.h"
+
+#ifndef _MODULE_H
+#define _MODULE_H
+
+#define MODULE__IMPORT  1  // "import ... from 'x'" or "import 'x'"
+#define MODULE__EXPORT  2  // "export ...", with a specifier if re-exported "from 'x'"
+#define MODULE__DYNAMIC 3  // "import('x')"
+#define MODULE__REQUIRE 4  // "require('x')"
+
+// A dependency or binding found by prsr_module_scan. Statements with many names yield one ref per
+// name, each with the same offset and specifier.
+typedef struct {
+  uint8_t type;
+  uint8_t is_default;  // name is "default", even if implicit, e.g. "import x from 'x'"
+  uint32_t offset;     // of the "import", "export" or "require" this is part of
+  token specifier;     // string (with quotes), or zero if none, or not a plain string
+  token name;          // name across the module boundary, "*" for namespaces, or zero if none
+  token local;         // binding in this module (or in the specifier, if re-exported), or zero
+} prsr_module_ref;
+
+typedef void (*prsr_module_callback)(void *, prsr_module_ref *);
+
+// yields the imports, exports, dynamic imports and require() calls of buf without a full parse:
+// statements are only matched at top-level, and inside groups (e.g. function bodies) only calls
+// are, returns 0 or the first error from the tokenizer (after scanning the rest anyway)
+int prsr_module_scan(char *buf, prsr_module_callback cb, void *arg);
+
+#endif//_MODULE_H
@@ -0,0 +1,227 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+// Parses many files on worker threads, printing "ret tokens bytes path" for each.
+// usage: ./native/run.sh batch [-j threads] [-module] [-trace out.json] [-cache dir [-cache-size MB]]
+//     [-l listfile] <file>...
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../parser.h"
+#include "file.h"
+#include "cache.h"
+#include "trace.h"
+
+#define MAX_THREADS 256
+
+typedef struct {
+  char **paths;
+  int count;
+  int next;  // next path to claim, shared by workers
+  int is_module;
+  int trace;
+  cachedef *cache;  // or NULL
+  pthread_mutex_t out_lock;
+} batchdef;
+
+typedef struct {
+  batchdef *b;
+  tracebuf trace;
+
+  token *tokens;  // reused between files
+  int tokens_len;
+  int tokens_cap;
+
+  int64_t bytes;
+  int64_t total_tokens;
+  int errors;
+} workerdef;
+
+static void collect(void *arg, token *t) {
+  workerdef *w = (workerdef *) arg;
+  if (w->tokens_len == w->tokens_cap) {
+    w->tokens_cap = w->tokens_cap ? w->tokens_cap * 2 : 4096;
+    w->tokens = realloc(w->tokens, sizeof(token) * w->tokens_cap);
+  }
+  w->tokens[w->tokens_len++] = *t;
+}
+
+static void *worker(void *arg) {
+  workerdef *w = (workerdef *) arg;
+  batchdef *b = w->b;
+  tracebuf *trace = b->trace ? &(w->trace) : NULL;
+
+  for (;;) {
+    int i = __atomic_fetch_add(&(b->next), 1, __ATOMIC_RELAXED);
+    if (i >= b->count) {
+      break;
+    }
+    const char *path = b->paths[i];
+
+    uint64_t start = trace_now();
+    int len;
+    char *buf = file_read(path, &len);
+    uint64_t read = trace_now();
+    trace_span(trace, "read", path, start, read);
+    if (!buf) {
+      fprintf(stderr, "can't read: %s\n", path);
+      ++w->errors;
+      continue;
+    }
+
+    w->tokens_len = 0;
+    int ret;
+    if (b->cache) {
+      ret = cache_simple(b->cache, buf, len, b->is_module, collect, w);
+    } else {
+      tokendef td = prsr_init_token(buf);
+      ret = prsr_simple(&td, b->is_module, collect, w);
+    }
+    uint64_t parsed = trace_now();
+    trace_span(trace, "parse", path, read, parsed);
+
+    pthread_mutex_lock(&(b->out_lock));
+    printf("%d %d %d %s\n", ret, w->tokens_len, len, path);
+    pthread_mutex_unlock(&(b->out_lock));
+    trace_span(trace, "emit", path, parsed, trace_now());
+
+    w->bytes += len;
+    w->total_tokens += w->tokens_len;
+    w->errors += (ret != 0);
+    free(buf);
+  }
+  return NULL;
+}
+
+// appends each line of listfile to paths
+static int read_list(const char *listfile, char ***paths, int *count, int *cap) {
+  FILE *f = fopen(listfile, "r");
+  if (!f) {
+    return -1;
+  }
+  char line[4096];
+  while (fgets(line, sizeof(line), f)) {
+    line[strcspn(line, "\r\n")] = 0;
+    if (!line[0]) {
+      continue;
+    }
+    if (*count == *cap) {
+      *cap *= 2;
+      *paths = realloc(*paths, sizeof(char *) * *cap);
+    }
+    (*paths)[(*count)++] = strdup(line);
+  }
+  fclose(f);
+  return 0;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "usage: %s [-j threads] [-module] [-trace out.json] [-cache dir [-cache-size MB]] "
+      "[-l listfile] <file>...\n", name);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  batchdef b = {0};
+  int threads = 4;
+  const char *trace_path = NULL;
+  const char *cache_dir = NULL;
+  int64_t cache_size = 256;
+  int cap = argc;
+  b.paths = malloc(sizeof(char *) * cap);
+
+  for (int i = 1; i < argc; ++i) {
+    char *arg = argv[i];
+    int has_value = (i + 1 < argc);
+    if (!strcmp(arg, "-j") && has_value) {
+      threads = atoi(argv[++i]);
+    } else if (!strcmp(arg, "-module")) {
+      b.is_module = 1;
+    } else if (!strcmp(arg, "-trace") && has_value) {
+      trace_path = argv[++i];
+    } else if (!strcmp(arg, "-cache") && has_value) {
+      cache_dir = argv[++i];
+    } else if (!strcmp(arg, "-cache-size") && has_value) {
+      cache_size = atoll(argv[++i]);
+    } else if (!strcmp(arg, "-l") && has_value) {
+      if (read_list(argv[++i], &b.paths, &b.count, &cap)) {
+        fprintf(stderr, "can't read list: %s\n", argv[i]);
+        return 1;
+      }
+    } else if (arg[0] == '-') {
+      usage(argv[0]);
+    } else {
+      b.paths[b.count++] = arg;
+    }
+  }
+  if (!b.count || threads < 1 || threads > MAX_THREADS) {
+    usage(argv[0]);
+  }
+  b.trace = (trace_path != NULL);
+  pthread_mutex_init(&b.out_lock, NULL);
+
+  cachedef cache;
+  if (cache_dir) {
+    if (cache_open(&cache, cache_dir, cache_size << 20)) {
+      fprintf(stderr, "can't open cache: %s\n", cache_dir);
+      return 1;
+    }
+    b.cache = &cache;
+  }
+
+  uint64_t start = trace_now();
+  workerdef *workers = calloc(threads, sizeof(workerdef));
+  pthread_t *ids = malloc(sizeof(pthread_t) * threads);
+  for (int i = 0; i < threads; ++i) {
+    workers[i].b = &b;
+    workers[i].trace.tid = i + 1;
+    pthread_create(&ids[i], NULL, worker, &workers[i]);
+  }
+
+  int64_t bytes = 0, tokens = 0;
+  int errors = 0;
+  tracebuf *traces = malloc(sizeof(tracebuf) * threads);
+  for (int i = 0; i < threads; ++i) {
+    pthread_join(ids[i], NULL);
+    bytes += workers[i].bytes;
+    tokens += workers[i].total_tokens;
+    errors += workers[i].errors;
+    traces[i] = workers[i].trace;
+    free(workers[i].tokens);
+  }
+  uint64_t took = trace_now() - start;
+
+  fprintf(stderr, "%d files, %lld bytes, %lld tokens, %d errors in %.2fms (%.1f MB/s, %d threads)\n",
+      b.count, (long long) bytes, (long long) tokens, errors, took / 1e6, bytes * 1e3 / took, threads);
+  if (b.cache) {
+    fprintf(stderr, "cache: %d hits, %d misses\n", cache.hits, cache.misses);
+    cache_close(&cache);
+  }
+
+  if (trace_path) {
+    if (trace_write(trace_path, traces, threads, start)) {
+      fprintf(stderr, "can't write trace: %s\n", trace_path);
+      return 1;
+    }
+    fprintf(stderr, "wrote trace: %s\n", trace_path);
+  }
+  for (int i = 0; i < threads; ++i) {
+    trace_free(&traces[i]);
+  }
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,270 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "../parser.h"
+#include "cache.h"
+#include "stream.h"
+
+#define STALE_TMP_SECONDS 600  // a temporary file this old was left by a crashed writer
+
+// forwards tokens to the caller while recording them
+typedef struct {
+  streamwriter w;
+  prsr_callback cb;
+  void *arg;
+} recorder;
+
+typedef struct {
+  char name[32];
+  int64_t size;
+  int64_t mtime;
+} cacheentry;
+
+static inline uint64_t rotl(uint64_t v, int by) {
+  return (v << by) | (v >> (64 - by));
+}
+
+static inline uint64_t mix(uint64_t h, uint64_t v) {
+  v *= 0x87c37b91114253d5ULL;
+  v = rotl(v, 31) * 0x4cf5ad432745937fULL;
+  return rotl(h ^ v, 27) * 5 + 0x52dce729;
+}
+
+uint64_t cache_hash(const char *buf, int len) {
+  // four independent lanes over 32 bytes at a time, so the multiplies overlap
+  uint64_t h[4] = {0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL, 0x165667b19e3779f9ULL, len};
+  int i = 0;
+  for (; i + 32 <= len; i += 32) {
+    uint64_t v[4];
+    memcpy(v, buf + i, 32);
+    h[0] = mix(h[0], v[0]);
+    h[1] = mix(h[1], v[1]);
+    h[2] = mix(h[2], v[2]);
+    h[3] = mix(h[3], v[3]);
+  }
+  uint64_t out = rotl(h[0], 1) + rotl(h[1], 7) + rotl(h[2], 12) + rotl(h[3], 18);
+  for (; i < len; i += 8) {
+    uint64_t v = 0;
+    memcpy(&v, buf + i, (len - i < 8) ? len - i : 8);
+    out = mix(out, v);
+  }
+
+  // final avalanche
+  out ^= out >> 33;
+  out *= 0xff51afd7ed558ccdULL;
+  out ^= out >> 33;
+  out *= 0xc4ceb9fe1a85ec53ULL;
+  return out ^ (out >> 33);
+}
+
+static void entry_path(cachedef *c, char *out, size_t size, uint64_t hash, int is_module) {
+  hash = mix(hash, STREAM__VERSION);  // salt, so a new format or parser misses older entries
+  snprintf(out, size, "%s/%016llx%c.tok", c->dir, (unsigned long long) hash, is_module ? 'm' : 's');
+}
+
+static int is_entry(const char *name) {
+  size_t len = strlen(name);
+  return len > 4 && !strcmp(name + len - 4, ".tok");
+}
+
+static int is_tmp(const char *name) {
+  return !strncmp(name, "tmp-", 4);
+}
+
+static int compare_mtime(const void *a, const void *b) {
+  const cacheentry *x = a, *y = b;
+  return (x->mtime > y->mtime) - (x->mtime < y->mtime);
+}
+
+// sums the size of every entry in dir, optionally returning them all, and removes stale
+// temporary files
+static int64_t scan(cachedef *c, cacheentry **all, int *count) {
+  DIR *d = opendir(c->dir);
+  if (!d) {
+    return 0;
+  }
+
+  int64_t total = 0;
+  int cap = 0;
+  time_t now = time(NULL);
+  struct dirent *ent;
+  while ((ent = readdir(d))) {
+    struct stat st;
+    char path[4096];
+    if (is_tmp(ent->d_name)) {
+      snprintf(path, sizeof(path), "%s/%s", c->dir, ent->d_name);
+      if (!lstat(path, &st) && S_ISREG(st.st_mode) && now - st.st_mtime > STALE_TMP_SECONDS) {
+        unlink(path);  // nb. a live writer is never this slow, and would just miss its rename
+      }
+      continue;
+    }
+    if (!is_entry(ent->d_name) || strlen(ent->d_name) >= sizeof(((cacheentry *) 0)->name)) {
+      continue;
+    }
+    snprintf(path, sizeof(path), "%s/%s", c->dir, ent->d_name);
+    if (stat(path, &st)) {
+      continue;  // removed since readdir
+    }
+    total += st.st_size;
+
+    if (!all) {
+      continue;
+    }
+    if (*count == cap) {
+      cap = cap ? cap * 2 : 256;
+      *all = realloc(*all, sizeof(cacheentry) * cap);
+    }
+    cacheentry *e = &((*all)[(*count)++]);
+    strcpy(e->name, ent->d_name);
+    e->size = st.st_size;
+#ifdef __APPLE__
+    e->mtime = (int64_t) st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    e->mtime = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+  }
+  closedir(d);
+  return total;
+}
+
+// removes the least recently used entries until dir is at 90% of its limit, unless another
+// thread or process is already doing so
+static void evict(cachedef *c) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/lock", c->dir);
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    return;
+  }
+  if (flock(fd, LOCK_EX | LOCK_NB)) {
+    close(fd);
+    return;
+  }
+
+  cacheentry *all = NULL;
+  int count = 0;
+  int64_t total = scan(c, &all, &count);
+  int64_t target = c->limit - c->limit / 10;
+  if (total > target) {
+    qsort(all, count, sizeof(cacheentry), compare_mtime);
+    for (int i = 0; i < count && total > target; ++i) {
+      snprintf(path, sizeof(path), "%s/%s", c->dir, all[i].name);
+      if (!unlink(path)) {
+        total -= all[i].size;
+      }
+    }
+  }
+  __atomic_store_n(&(c->size), total, __ATOMIC_RELAXED);
+  free(all);
+
+  flock(fd, LOCK_UN);
+  close(fd);
+}
+
+int cache_open(cachedef *c, const char *dir, int64_t limit) {
+  bzero(c, sizeof(cachedef));
+  if (mkdir(dir, 0755) && errno != EEXIST) {
+    return -1;
+  }
+  c->dir = strdup(dir);
+  c->limit = limit;
+  c->size = scan(c, NULL, NULL);
+  if (limit && c->size > limit) {
+    evict(c);  // the limit may have shrunk since last time
+  }
+  return 0;
+}
+
+void cache_close(cachedef *c) {
+  free(c->dir);
+  c->dir = NULL;
+}
+
+// replays the entry at path if it matches, returns 0 if replayed
+static int replay(const char *path, char *buf, int len, int is_module, prsr_callback cb,
+    void *arg, int *ret) {
+  streamreader r;
+  if (stream_open(&r, path, buf)) {
+    return -1;
+  }
+
+  // check the whole stream (and the hash of the source it was made from, independent of the one
+  // in path) before yielding any tokens, so a bad entry or a collision is a clean miss
+  if (r.header->is_module != (uint32_t) is_module || stream_check(&r, len)) {
+    stream_close(&r);
+    return -1;
+  }
+  utimensat(AT_FDCWD, path, NULL, 0);  // mark as recently used
+
+  *ret = stream_replay(&r, cb, arg);
+  stream_close(&r);
+  return 0;
+}
+
+static void record(void *arg, token *t) {
+  recorder *r = (recorder *) arg;
+  stream_write(&(r->w), t);
+  r->cb(r->arg, t);
+}
+
+// writes a new entry via a temporary file, returns its size or -1 on error
+static int64_t store(cachedef *c, const char *path, streamwriter *w, int len, int is_module,
+    int ret) {
+  char tmp[4096];
+  int n = __atomic_fetch_add(&(c->next_tmp), 1, __ATOMIC_RELAXED);
+  snprintf(tmp, sizeof(tmp), "%s/tmp-%d-%d", c->dir, (int) getpid(), n);
+
+  if (stream_save(w, tmp, len, is_module, ret) || rename(tmp, path)) {
+    unlink(tmp);
+    return -1;
+  }
+  return sizeof(streamheader) + w->size;
+}
+
+int cache_simple(cachedef *c, char *buf, int len, int is_module, prsr_callback cb, void *arg) {
+  char path[4096];
+  entry_path(c, path, sizeof(path), cache_hash(buf, len), is_module);
+
+  int ret;
+  if (!replay(path, buf, len, is_module, cb, arg, &ret)) {
+    __atomic_fetch_add(&(c->hits), 1, __ATOMIC_RELAXED);
+    return ret;
+  }
+  __atomic_fetch_add(&(c->misses), 1, __ATOMIC_RELAXED);
+
+  recorder r = {.cb = cb, .arg = arg};
+  stream_writer_init(&(r.w), buf);
+  tokendef td = prsr_init_token(buf);
+  ret = prsr_simple(&td, is_module, record, &r);
+
+  int64_t size = store(c, path, &(r.w), len, is_module, ret);
+  stream_writer_free(&(r.w));
+  if (size > 0 && c->limit &&
+      __atomic_add_fetch(&(c->size), size, __ATOMIC_RELAXED) > c->limit) {
+    evict(c);
+  }
+  return ret;
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+#include <stdint.h>
+#include "../token.h"
+
+#ifndef _NATIVE_CACHE_H
+#define _NATIVE_CACHE_H
+
+// An on-disk cache of token streams (see stream.h), keyed by the content of the source, is_module
+// and the stream version (so entries from an older parser are never replayed). Each hit is also
+// checked against a second hash of the source stored in the stream, so a collision is a miss.
+// Entries are written to a temporary file and renamed into place, so readers in other threads or
+// processes only ever see whole entries (temporary files left by a crash are removed later). Hits
+// bump the entry's mtime, and once the directory is over its limit, the least recently used
+// entries are removed (by one process at a time).
+typedef struct {
+  char *dir;
+  int64_t limit;  // bytes, or zero for no limit
+  int64_t size;   // approximate bytes in dir
+
+  int next_tmp;
+  int hits;
+  int misses;
+} cachedef;
+
+// hashes len bytes of buf
+uint64_t cache_hash(const char *buf, int len);
+
+// uses (and creates) dir as a cache of at most limit bytes, returns 0 or -1 on error
+int cache_open(cachedef *c, const char *dir, int64_t limit);
+
+// parses buf (of len bytes) like prsr_simple, or replays its tokens from the cache, and may be
+// called from many threads at once
+int cache_simple(cachedef *c, char *buf, int len, int is_module, prsr_callback cb, void *arg);
+
+void cache_close(cachedef *c);
+
+#endif//_NATIVE_CACHE_H
@@ -0,0 +1,683 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+// Serves token streams over a Unix socket, keeping recent ones in memory.
+// usage: ./native/run.sh daemon -socket path [-size MB]
+//        ./native/run.sh daemon -connect path [-module] [-summary] [-send] <file>...
+//
+// Each request is a line "<verb> <flags> <arg>\n", where flags is '-' or any of 'm' (parse as a
+// module) and 's' (summary only, without the stream):
+//   path <flags> <path>  parses the file at path (relative to the daemon)
+//   buf <flags> <len>    parses the len bytes (at most 256MB) that follow the line
+//   stats - -            reports the cache
+// Replies are "ok <ret> <tokens> <bytes>\n" followed by bytes of stream (see stream.h), or
+// "err <message>\n". Stats replies are "ok <hits> <misses> <entries> <bytes>\n".
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "../parser.h"
+#include "cache.h"
+#include "file.h"
+#include "stream.h"
+
+#define BUCKETS  4096
+#define MAX_LINE (PATH_MAX + 64)
+#define MAX_BUF  (256 << 20)  // largest source sent with "buf"
+
+typedef struct _entry {
+  struct _entry *prev;  // more recently used
+  struct _entry *next;  // less recently used
+  struct _entry *chain;
+
+  char *path;  // or NULL if sent as a buffer
+  int64_t mtime;
+  int len;
+  uint64_t hash;  // of the content
+  int is_module;
+
+  int ret;
+  uint32_t tokens;
+  void *stream;
+  size_t size;
+
+  int refs;     // replies still writing stream
+  int removed;  // no longer cached, so freed once refs is zero
+} entry;
+
+typedef struct _conn {
+  struct _conn *next;  // other open connections
+  struct _lru *l;
+  int fd;
+  char buf[4096];
+  int at;
+  int len;
+} conn;
+
+// Each connection has its own thread. The lock is held to use the cache, but not while parsing or
+// replying, so one slow or idle client never holds up the others.
+typedef struct _lru {
+  pthread_mutex_t lock;
+  pthread_cond_t idle;  // signalled as each connection closes
+  conn *conns;          // open connections
+
+  entry *buckets[BUCKETS];
+  entry *head;
+  entry *tail;
+  int64_t bytes;
+  int64_t limit;
+  int count;
+  int requests;
+  int misses;  // requests that needed a parse
+} lru;
+
+static atomic_int stopped;  // nb. lock-free, so safe to set from a signal handler
+
+static void on_stop(int sig) {
+  (void) sig;
+  stopped = 1;
+}
+
+static uint64_t key_of(const char *path, uint64_t hash) {
+  return path ? cache_hash(path, strlen(path)) : hash;
+}
+
+static void unlink_lru(lru *l, entry *e) {
+  *(e->prev ? &(e->prev->next) : &(l->head)) = e->next;
+  *(e->next ? &(e->next->prev) : &(l->tail)) = e->prev;
+  e->prev = e->next = NULL;
+}
+
+static void push_lru(lru *l, entry *e) {
+  e->next = l->head;
+  *(l->head ? &(l->head->prev) : &(l->tail)) = e;
+  l->head = e;
+}
+
+static void free_entry(entry *e) {
+  free(e->path);
+  free(e->stream);
+  free(e);
+}
+
+// removes e from the cache, freeing it unless a reply is still writing it
+static void remove_entry(lru *l, entry *e) {
+  entry **at = &(l->buckets[key_of(e->path, e->hash) % BUCKETS]);
+  while (*at != e) {
+    at = &((*at)->chain);
+  }
+  *at = e->chain;
+  unlink_lru(l, e);
+
+  l->bytes -= e->size;
+  --l->count;
+  if (e->refs) {
+    e->removed = 1;
+  } else {
+    free_entry(e);
+  }
+}
+
+// counts a request for e (with the lock held), marking it most recently used and holding it for
+// the reply until release_entry
+static entry *use_entry(lru *l, entry *e) {
+  ++e->refs;
+  ++l->requests;
+  if (!e->removed) {
+    unlink_lru(l, e);
+    push_lru(l, e);
+  }
+  return e;
+}
+
+static void release_entry(lru *l, entry *e) {
+  pthread_mutex_lock(&(l->lock));
+  if (!--e->refs && e->removed) {
+    free_entry(e);
+  }
+  pthread_mutex_unlock(&(l->lock));
+}
+
+// finds the entry for path (or for a buffer of hash and len, if path is NULL)
+static entry *find_entry(lru *l, const char *path, uint64_t hash, int len, int is_module) {
+  entry *e = l->buckets[key_of(path, hash) % BUCKETS];
+  for (; e; e = e->chain) {
+    if (e->is_module != is_module) {
+      continue;
+    }
+    if (path ? (e->path && !strcmp(e->path, path)) : (!e->path && e->hash == hash && e->len == len)) {
+      return e;
+    }
+  }
+  return NULL;
+}
+
+// parses buf into a new entry (without the lock), returns NULL if out of memory
+static entry *parse_entry(const char *path, int64_t mtime, char *buf, int len, uint64_t hash,
+    int is_module) {
+  streamwriter w;
+  stream_writer_init(&w, buf);
+  tokendef td = prsr_init_token(buf);
+  int ret = prsr_simple(&td, is_module, stream_write, &w);
+
+  entry *e = calloc(1, sizeof(entry));
+  if (e) {
+    e->stream = stream_finish(&w, len, is_module, ret, &(e->size));
+  }
+  stream_writer_free(&w);
+  if (!e || !e->stream) {
+    free(e);
+    return NULL;
+  }
+
+  e->tokens = w.count;
+  e->path = path ? strdup(path) : NULL;
+  e->mtime = mtime;
+  e->len = len;
+  e->hash = hash;
+  e->is_module = is_module;
+  e->ret = ret;
+  return e;
+}
+
+// adds fresh as the most recently used entry (replacing any older one for its path), unless
+// another request added the same content while it was parsed, evicting others if over the limit
+static entry *add_entry(lru *l, entry *fresh) {
+  pthread_mutex_lock(&(l->lock));
+  entry *e = find_entry(l, fresh->path, fresh->hash, fresh->len, fresh->is_module);
+  if (e && e->hash == fresh->hash && e->len == fresh->len) {
+    e->mtime = fresh->mtime;
+    free_entry(fresh);
+  } else {
+    if (e) {
+      remove_entry(l, e);
+    }
+    e = fresh;
+    entry **bucket = &(l->buckets[key_of(e->path, e->hash) % BUCKETS]);
+    e->chain = *bucket;
+    *bucket = e;
+    push_lru(l, e);
+    l->bytes += e->size;
+    ++l->count;
+    ++l->misses;
+
+    while (l->bytes > l->limit && l->tail != e) {
+      remove_entry(l, l->tail);
+    }
+  }
+  use_entry(l, e);
+  pthread_mutex_unlock(&(l->lock));
+  return e;
+}
+
+// returns the entry for the file at path, parsing it only if changed, or NULL with an error
+static entry *lookup_path(lru *l, const char *path, int is_module, const char **error) {
+  struct stat st;
+  if (stat(path, &st)) {
+    *error = "can't read file";
+    return NULL;
+  }
+#ifdef __APPLE__
+  int64_t mtime = (int64_t) st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+  int64_t mtime = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+
+  pthread_mutex_lock(&(l->lock));
+  entry *e = find_entry(l, path, 0, 0, is_module);
+  if (e && e->mtime == mtime && e->len == st.st_size) {
+    use_entry(l, e);
+  } else {
+    e = NULL;
+  }
+  pthread_mutex_unlock(&(l->lock));
+  if (e) {
+    return e;
+  }
+
+  // the file was touched or is new, so check its content
+  int len;
+  char *buf = file_read(path, &len);
+  if (!buf) {
+    *error = "can't read file";
+    return NULL;
+  }
+  uint64_t hash = cache_hash(buf, len);
+
+  pthread_mutex_lock(&(l->lock));
+  e = find_entry(l, path, 0, 0, is_module);
+  if (e && e->hash == hash && e->len == len) {
+    e->mtime = mtime;
+    use_entry(l, e);
+  } else {
+    e = NULL;
+  }
+  pthread_mutex_unlock(&(l->lock));
+
+  if (!e && (e = parse_entry(path, mtime, buf, len, hash, is_module))) {
+    e = add_entry(l, e);
+  }
+  free(buf);
+  if (!e) {
+    *error = "out of memory";
+  }
+  return e;
+}
+
+// returns the entry for the len bytes of buf, parsing them only if new, or NULL if out of memory
+static entry *lookup_buf(lru *l, char *buf, int len, int is_module) {
+  uint64_t hash = cache_hash(buf, len);
+  pthread_mutex_lock(&(l->lock));
+  entry *e = find_entry(l, NULL, hash, len, is_module);
+  if (e) {
+    use_entry(l, e);
+  }
+  pthread_mutex_unlock(&(l->lock));
+
+  if (!e && (e = parse_entry(NULL, 0, buf, len, hash, is_module))) {
+    e = add_entry(l, e);
+  }
+  return e;
+}
+
+static int write_all(int fd, const void *data, size_t size) {
+  const char *at = data;
+  while (size) {
+    ssize_t n = write(fd, at, size);
+    if (n < 0 && errno == EINTR && !stopped) {
+      continue;
+    } else if (n <= 0) {
+      return -1;
+    }
+    at += n;
+    size -= n;
+  }
+  return 0;
+}
+
+// reads size bytes, using any already buffered by read_line first
+static int read_all(conn *c, void *data, size_t size) {
+  char *at = data;
+  int buffered = c->len - c->at;
+  if (buffered > 0) {
+    int n = (size_t) buffered < size ? buffered : (int) size;
+    memcpy(at, c->buf + c->at, n);
+    c->at += n;
+    at += n;
+    size -= n;
+  }
+  while (size) {
+    ssize_t n = read(c->fd, at, size);
+    if (n < 0 && errno == EINTR && !stopped) {
+      continue;
+    } else if (n <= 0) {
+      return -1;
+    }
+    at += n;
+    size -= n;
+  }
+  return 0;
+}
+
+// reads a line without its '\n' into out, returns its length or -1 on EOF or error
+static int read_line(conn *c, char *out, int max) {
+  int len = 0;
+  for (;;) {
+    if (c->at == c->len) {
+      ssize_t n = read(c->fd, c->buf, sizeof(c->buf));
+      if (n < 0 && errno == EINTR && !stopped) {
+        continue;
+      } else if (n <= 0) {
+        return -1;
+      }
+      c->at = 0;
+      c->len = n;
+    }
+    char ch = c->buf[c->at++];
+    if (ch == '\n') {
+      out[len] = 0;
+      return len;
+    } else if (len == max - 1) {
+      return -1;
+    }
+    out[len++] = ch;
+  }
+}
+
+static int reply_error(int fd, const char *message) {
+  char line[256];
+  snprintf(line, sizeof(line), "err %s\n", message);
+  return write_all(fd, line, strlen(line));
+}
+
+static int reply_entry(int fd, entry *e, int summary) {
+  char line[128];
+  size_t size = summary ? 0 : e->size;
+  snprintf(line, sizeof(line), "ok %d %u %zu\n", e->ret, e->tokens, size);
+  if (write_all(fd, line, strlen(line))) {
+    return -1;
+  }
+  return write_all(fd, e->stream, size);
+}
+
+// handles one request, returns -1 if the connection should be closed
+static int handle(lru *l, conn *c) {
+  char line[MAX_LINE];
+  char verb[8], flags[8];
+  int at = 0;
+  if (read_line(c, line, sizeof(line)) < 0) {
+    return -1;
+  }
+  if (sscanf(line, "%7s %7s %n", verb, flags, &at) != 2 || !at || !line[at]) {
+    return reply_error(c->fd, "bad request");
+  }
+  char *arg = line + at;  // the rest of the line, as paths may have spaces
+  int is_module = (strchr(flags, 'm') != NULL);
+  int summary = (strchr(flags, 's') != NULL);
+
+  if (!strcmp(verb, "stats")) {
+    pthread_mutex_lock(&(l->lock));
+    snprintf(line, sizeof(line), "ok %d %d %d %lld\n", l->requests - l->misses, l->misses, l->count,
+        (long long) l->bytes);
+    pthread_mutex_unlock(&(l->lock));
+    return write_all(c->fd, line, strlen(line));
+  }
+
+  entry *e;
+  if (!strcmp(verb, "path")) {
+    const char *error;
+    if (!(e = lookup_path(l, arg, is_module, &error))) {
+      return reply_error(c->fd, error);
+    }
+  } else if (!strcmp(verb, "buf")) {
+    char *end;
+    long len = strtol(arg, &end, 10);
+    if (*end || len < 0 || len > MAX_BUF) {
+      reply_error(c->fd, "bad length");
+      return -1;  // can't skip the bytes that follow
+    }
+    char *buf = malloc(len + FILE__PADDING);
+    if (!buf || read_all(c, buf, len)) {
+      free(buf);
+      return -1;
+    }
+    memset(buf + len, 0, FILE__PADDING);
+
+    e = lookup_buf(l, buf, len, is_module);
+    free(buf);
+    if (!e) {
+      return reply_error(c->fd, "out of memory");
+    }
+  } else {
+    return reply_error(c->fd, "unknown verb");
+  }
+
+  int ret = reply_entry(c->fd, e, summary);
+  release_entry(l, e);
+  return ret;
+}
+
+// forgets and closes c
+static void close_conn(lru *l, conn *c) {
+  pthread_mutex_lock(&(l->lock));
+  conn **at = &(l->conns);
+  while (*at != c) {
+    at = &((*at)->next);
+  }
+  *at = c->next;
+  close(c->fd);  // nb. under the lock, so serve never shuts down a reused fd
+  pthread_cond_signal(&(l->idle));
+  pthread_mutex_unlock(&(l->lock));
+  free(c);
+}
+
+// serves requests on one connection until it closes
+static void *run_conn(void *arg) {
+  conn *c = (conn *) arg;
+  while (!stopped && !handle(c->l, c));
+  close_conn(c->l, c);
+  return NULL;
+}
+
+static int open_socket(const char *path, struct sockaddr_un *addr) {
+  if (strlen(path) >= sizeof(addr->sun_path)) {
+    return -1;
+  }
+  bzero(addr, sizeof(struct sockaddr_un));
+  addr->sun_family = AF_UNIX;
+  strcpy(addr->sun_path, path);
+  return socket(AF_UNIX, SOCK_STREAM, 0);
+}
+
+// removes the socket at path, returns 0 if it's gone (or never existed) or -1 if path is something
+// else, which is never removed
+static int remove_socket(const char *path) {
+  struct stat st;
+  if (lstat(path, &st)) {
+    return errno == ENOENT ? 0 : -1;
+  }
+  return S_ISSOCK(st.st_mode) ? unlink(path) : -1;
+}
+
+static int serve(const char *path, int64_t limit) {
+  struct sockaddr_un addr;
+  int fd = open_socket(path, &addr);
+  if (fd < 0) {
+    fprintf(stderr, "can't create socket: %s\n", path);
+    return 1;
+  }
+  if (remove_socket(path)) {  // left over from an earlier run
+    fprintf(stderr, "can't remove old socket: %s (is it a socket?)\n", path);
+    close(fd);
+    return 1;
+  }
+  if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) || listen(fd, 64)) {
+    fprintf(stderr, "can't listen on: %s (%s)\n", path, strerror(errno));
+    return 1;
+  }
+
+  // no SA_RESTART, so that accept returns on a signal (which connection threads block)
+  struct sigaction sa;
+  bzero(&sa, sizeof(sa));
+  sa.sa_handler = on_stop;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  signal(SIGPIPE, SIG_IGN);
+  sigset_t stops, prev;
+  sigemptyset(&stops);
+  sigaddset(&stops, SIGINT);
+  sigaddset(&stops, SIGTERM);
+
+  lru *l = calloc(1, sizeof(lru));
+  pthread_mutex_init(&(l->lock), NULL);
+  pthread_cond_init(&(l->idle), NULL);
+  l->limit = limit;
+  fprintf(stderr, "listening on %s (%lldMB)\n", path, (long long) (limit >> 20));
+
+  while (!stopped) {
+    int conn_fd = accept(fd, NULL, NULL);
+    if (conn_fd < 0) {
+      continue;
+    }
+    conn *c = calloc(1, sizeof(conn));
+    c->fd = conn_fd;
+    c->l = l;
+    pthread_mutex_lock(&(l->lock));
+    c->next = l->conns;
+    l->conns = c;
+    pthread_mutex_unlock(&(l->lock));
+
+    pthread_t id;
+    pthread_sigmask(SIG_BLOCK, &stops, &prev);
+    if (!pthread_create(&id, NULL, run_conn, c)) {
+      pthread_detach(id);
+    } else {
+      close_conn(l, c);
+    }
+    pthread_sigmask(SIG_SETMASK, &prev, NULL);
+  }
+
+  // wake connections waiting on their clients, and wait for them to finish
+  pthread_mutex_lock(&(l->lock));
+  for (conn *c = l->conns; c; c = c->next) {
+    shutdown(c->fd, SHUT_RDWR);
+  }
+  while (l->conns) {
+    pthread_cond_wait(&(l->idle), &(l->lock));
+  }
+  pthread_mutex_unlock(&(l->lock));
+
+  fprintf(stderr, "stopping: %d hits, %d misses, %d entries, %lld bytes\n",
+      l->requests - l->misses, l->misses, l->count, (long long) l->bytes);
+  while (l->tail) {
+    remove_entry(l, l->tail);
+  }
+  pthread_cond_destroy(&(l->idle));
+  pthread_mutex_destroy(&(l->lock));
+  free(l);
+  close(fd);
+  remove_socket(path);
+  return 0;
+}
+
+// sends each file to the daemon, printing "ret tokens bytes path" like batch
+static int query(const char *path, char **files, int count, const char *flags, int send) {
+  struct sockaddr_un addr;
+  conn c = {0};
+  if ((c.fd = open_socket(path, &addr)) < 0 ||
+      connect(c.fd, (struct sockaddr *) &addr, sizeof(addr))) {
+    fprintf(stderr, "can't connect to: %s\n", path);
+    return 1;
+  }
+
+  int errors = 0;
+  char line[MAX_LINE];
+  for (int i = 0; i < count; ++i) {
+    char *buf = NULL;
+    int len = 0;
+    if (send) {
+      if (!(buf = file_read(files[i], &len))) {
+        fprintf(stderr, "can't read: %s\n", files[i]);
+        ++errors;
+        continue;
+      }
+      snprintf(line, sizeof(line), "buf %s %d\n", flags, len);
+    } else {
+      char full[PATH_MAX];
+      if (!realpath(files[i], full)) {
+        fprintf(stderr, "can't find: %s\n", files[i]);
+        ++errors;
+        continue;
+      }
+      snprintf(line, sizeof(line), "path %s %s\n", flags, full);
+    }
+    if (write_all(c.fd, line, strlen(line)) || (buf && write_all(c.fd, buf, len)) ||
+        read_line(&c, line, sizeof(line)) < 0) {
+      fprintf(stderr, "connection lost\n");
+      free(buf);
+      return 1;
+    }
+    free(buf);
+
+    int ret;
+    unsigned tokens;
+    size_t size;
+    if (sscanf(line, "ok %d %u %zu", &ret, &tokens, &size) != 3) {
+      fprintf(stderr, "%s: %s\n", files[i], line);
+      ++errors;
+      continue;
+    }
+    void *stream = malloc(size ? size : 1);
+    if (read_all(&c, stream, size)) {
+      fprintf(stderr, "connection lost\n");
+      free(stream);
+      return 1;
+    }
+
+    // check the stream is whole (a real client would read its tokens here)
+    streamreader r;
+    if (size && (stream_from(&r, stream, size, NULL) || r.header->count != tokens)) {
+      fprintf(stderr, "%s: bad stream\n", files[i]);
+      ++errors;
+    }
+    free(stream);
+    printf("%d %u %zu %s\n", ret, tokens, size, files[i]);
+  }
+
+  write_all(c.fd, "stats - -\n", 10);
+  if (read_line(&c, line, sizeof(line)) >= 0) {
+    fprintf(stderr, "daemon: %s\n", line);
+  }
+  close(c.fd);
+  return errors ? 1 : 0;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "usage: %s -socket path [-size MB]\n"
+      "       %s -connect path [-module] [-summary] [-send] <file>...\n", name, name);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  const char *listen_path = NULL;
+  const char *connect_path = NULL;
+  int64_t size = 256;
+  int is_module = 0, summary = 0, send = 0;
+  char **files = malloc(sizeof(char *) * argc);
+  int count = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    char *arg = argv[i];
+    int has_value = (i + 1 < argc);
+    if (!strcmp(arg, "-socket") && has_value) {
+      listen_path = argv[++i];
+    } else if (!strcmp(arg, "-connect") && has_value) {
+      connect_path = argv[++i];
+    } else if (!strcmp(arg, "-size") && has_value) {
+      size = atoll(argv[++i]);
+    } else if (!strcmp(arg, "-module")) {
+      is_module = 1;
+    } else if (!strcmp(arg, "-summary")) {
+      summary = 1;
+    } else if (!strcmp(arg, "-send")) {
+      send = 1;
+    } else if (arg[0] == '-') {
+      usage(argv[0]);
+    } else {
+      files[count++] = arg;
+    }
+  }
+
+  if (listen_path && !connect_path && !count) {
+    return serve(listen_path, size << 20);
+  } else if (connect_path && !listen_path && count) {
+    char flags[4] = "-";
+    if (is_module || summary) {
+      snprintf(flags, sizeof(flags), "%s%s", is_module ? "m" : "", summary ? "s" : "");
+    }
+    return query(connect_path, files, count, flags, send);
+  }
+  usage(argv[0]);
+}
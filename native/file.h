@@ -0,0 +1,25 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+#ifndef _NATIVE_FILE_H
+#define _NATIVE_FILE_H
+
+#define FILE__PADDING 64  // trailing NULs, so index blocks never run past the allocation
+
+// reads path into a new buffer with FILE__PADDING trailing NULs, returns NULL on error
+char *file_read(const char *path, int *len);
+
+#endif//_NATIVE_FILE_H
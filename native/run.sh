@@ -0,0 +1,20 @@
+#!/bin/bash
+# usage: ./native/run.sh <name> [args...], builds and runs native/<name>.c
+
+DIR="${BASH_SOURCE%/*}"
+NAME="${1:?usage: $0 <name> [args...]}"
+shift
+
+set -eu
+
+# link the shared native sources, but not the other tools (anything else with a main)
+SOURCES=()
+for SRC in "${DIR}"/*.c; do
+  if [[ "${SRC}" == "${DIR}/${NAME}.c" ]] || ! grep -q "^int main(" "${SRC}"; then
+    SOURCES+=("${SRC}")
+  fi
+done
+
+clang -O2 -pthread -o "${DIR}/_${NAME}" "${DIR}"/../*.c "${SOURCES[@]}"
+"${DIR}/_${NAME}" "$@"
+rm "${DIR}/_${NAME}"
@@ -0,0 +1,277 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "stream.h"
+
+#define MAX_TOKEN_BYTES 21  // type byte, then up to four varints of five bytes
+
+// hashes len bytes of buf, independently of cache_hash (so a collision there is still caught here)
+static uint64_t source_hash(const char *buf, int len) {
+  uint64_t h = 0x243f6a8885a308d3ULL ^ (uint64_t) len;
+  for (int i = 0; i < len; i += 8) {
+    uint64_t v = 0;
+    memcpy(&v, buf + i, (len - i < 8) ? len - i : 8);
+    h = (h ^ v) * 0x9fb21c651e98df25ULL;
+    h ^= h >> 29;
+  }
+  h *= 0xd6e8feb86659fd93ULL;
+  return h ^ (h >> 32);
+}
+
+static inline uint32_t zigzag(int32_t v) {
+  return ((uint32_t) v << 1) ^ (uint32_t) (v >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t v) {
+  return (int32_t) (v >> 1) ^ -(int32_t) (v & 1);
+}
+
+static inline uint8_t *put_varint(uint8_t *at, uint64_t v) {
+  while (v >= 0x80) {
+    *at++ = (uint8_t) v | 0x80;
+    v >>= 7;
+  }
+  *at++ = (uint8_t) v;
+  return at;
+}
+
+// reads a varint into out, returns NULL if it runs past end
+static inline const uint8_t *get_varint(const uint8_t *at, const uint8_t *end, uint64_t *out) {
+  uint64_t v = 0;
+  for (int shift = 0; at < end && shift < 64; shift += 7) {
+    uint8_t b = *at++;
+    v |= (uint64_t) (b & 0x7f) << shift;
+    if (!(b & 0x80)) {
+      *out = v;
+      return at;
+    }
+  }
+  return NULL;
+}
+
+void stream_writer_init(streamwriter *w, char *buf) {
+  bzero(w, sizeof(streamwriter));
+  w->buf = buf;
+}
+
+void stream_write(void *arg, token *t) {
+  streamwriter *w = (streamwriter *) arg;
+  if (w->failed) {
+    return;
+  } else if (w->size + MAX_TOKEN_BYTES > w->cap) {
+    size_t cap = w->cap ? w->cap * 2 : 16384;
+    uint8_t *data = realloc(w->data, cap);
+    if (!data) {
+      w->failed = 1;
+      return;
+    }
+    w->data = data;
+    w->cap = cap;
+  }
+  uint8_t *at = w->data + w->size;
+
+  // the low bits of the first varint say whether text and a hash follow
+  *at++ = t->type | (t->mark << 5);
+  uint64_t flags = (t->p ? 2 : 0) | (t->hash ? 1 : 0);
+  if (t->p) {
+    uint32_t offset = t->p - w->buf;
+    at = put_varint(at, ((uint64_t) zigzag(offset - w->prev_end) << 2) | flags);
+    at = put_varint(at, t->len);
+    w->prev_end = offset + t->len;
+  } else {
+    at = put_varint(at, flags);
+  }
+  at = put_varint(at, zigzag(t->line_no - w->prev_line_no));
+  w->prev_line_no = t->line_no;
+  if (t->hash) {
+    at = put_varint(at, t->hash);
+  }
+
+  w->size = at - w->data;
+  ++w->count;
+}
+
+static void fill_header(streamwriter *w, streamheader *header, int len, int is_module, int ret) {
+  memcpy(header->magic, STREAM__MAGIC, 4);
+  header->version = STREAM__VERSION;
+  header->len = len;
+  header->ret = ret;
+  header->is_module = is_module;
+  header->count = w->count;
+  header->size = w->size;
+  header->source = source_hash(w->buf, len);
+}
+
+int stream_save(streamwriter *w, const char *path, int len, int is_module, int ret) {
+  if (w->failed) {
+    return -1;
+  }
+  streamheader header;
+  fill_header(w, &header, len, is_module, ret);
+
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    return -1;
+  }
+  int ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+      fwrite(w->data, 1, w->size, f) == w->size;
+  return (fclose(f) || !ok) ? -1 : 0;
+}
+
+void *stream_finish(streamwriter *w, int len, int is_module, int ret, size_t *size) {
+  if (w->failed) {
+    return NULL;
+  }
+  *size = sizeof(streamheader) + w->size;
+  uint8_t *out = malloc(*size);
+  if (out) {
+    fill_header(w, (streamheader *) out, len, is_module, ret);
+    memcpy(out + sizeof(streamheader), w->data, w->size);
+  }
+  return out;
+}
+
+void stream_writer_free(streamwriter *w) {
+  free(w->data);
+  w->data = NULL;
+  w->size = w->cap = 0;
+}
+
+int stream_from(streamreader *r, const void *data, size_t size, char *buf) {
+  bzero(r, sizeof(streamreader));
+  const streamheader *header = data;
+  if (size < sizeof(streamheader) || memcmp(header->magic, STREAM__MAGIC, 4) ||
+      header->version != STREAM__VERSION || size != sizeof(streamheader) + header->size) {
+    return -1;
+  }
+  r->header = header;
+  r->at = (const uint8_t *) (header + 1);
+  r->end = r->at + header->size;
+  r->buf = buf;
+  r->offset = STREAM__NO_P;
+  return 0;
+}
+
+int stream_open(streamreader *r, const char *path, char *buf) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (!fstat(fd, &st) && st.st_size >= (off_t) sizeof(streamheader)) {
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (map == MAP_FAILED) {
+    return -1;
+  }
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  if (stream_from(r, map, st.st_size, buf)) {
+    munmap(map, st.st_size);
+    return -1;
+  }
+  r->map = map;
+  r->map_size = st.st_size;
+  return 0;
+}
+
+int stream_next(streamreader *r, token *out) {
+  if (r->at == r->end) {
+    return 0;
+  }
+  const uint8_t *at = r->at;
+  uint8_t tag = *at++;
+  uint64_t first, line, len = 0, hash = 0;
+  if (!(at = get_varint(at, r->end, &first))) {
+    return -1;
+  }
+
+  r->offset = STREAM__NO_P;
+  if (first & 2) {
+    if (!(at = get_varint(at, r->end, &len))) {
+      return -1;
+    }
+    uint32_t offset = r->prev_end + unzigzag(first >> 2);
+    if ((uint64_t) offset + len > r->header->len || (first >> 34)) {
+      return -1;
+    }
+    r->offset = offset;
+    r->prev_end = offset + len;
+  }
+  if (!(at = get_varint(at, r->end, &line)) ||
+      ((first & 1) && !(at = get_varint(at, r->end, &hash)))) {
+    return -1;
+  }
+  r->prev_line_no += unzigzag(line);
+  r->at = at;
+
+  out->p = (r->buf && r->offset != STREAM__NO_P) ? r->buf + r->offset : NULL;
+  out->len = len;
+  out->line_no = r->prev_line_no;
+  out->type = tag & 0x1f;
+  out->mark = tag >> 5;
+  out->hash = hash;
+  out->id = 0;
+  return 1;
+}
+
+int stream_check(streamreader *r, int len) {
+  if (r->header->version != STREAM__VERSION || r->header->len != (uint32_t) len ||
+      (r->buf && r->header->source != source_hash(r->buf, len))) {
+    return -1;
+  }
+  const uint8_t *start = r->at;
+  uint32_t prev_end = r->prev_end;
+  int prev_line_no = r->prev_line_no;
+
+  token t;
+  uint32_t count = 0;
+  int ret;
+  while ((ret = stream_next(r, &t)) > 0) {
+    ++count;
+  }
+
+  r->at = start;
+  r->prev_end = prev_end;
+  r->prev_line_no = prev_line_no;
+  r->offset = STREAM__NO_P;
+  return (ret || count != r->header->count) ? -1 : 0;
+}
+
+int stream_replay(streamreader *r, prsr_callback cb, void *arg) {
+  token t;
+  int ret;
+  while ((ret = stream_next(r, &t)) > 0) {
+    cb(arg, &t);
+  }
+  return ret ? ERROR__INTERNAL : r->header->ret;
+}
+
+void stream_close(streamreader *r) {
+  if (r->map) {
+    munmap(r->map, r->map_size);
+  }
+  bzero(r, sizeof(streamreader));
+}
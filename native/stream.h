@@ -0,0 +1,106 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../token.h"
+
+#ifndef _NATIVE_STREAM_H
+#define _NATIVE_STREAM_H
+
+// A serialized token stream: a streamheader, then each token as a byte of type and mark, followed
+// by varints of its offset (from the end of the previous token) and length, its line (from the
+// previous line) and its hash, each only if needed. Offsets and lines are zigzag-encoded.
+
+#define STREAM__MAGIC   "PRSt"
+#define STREAM__VERSION 3  // bump whenever this encoding or the parser's output changes
+#define STREAM__NO_P    0xffffffff  // offset of virtual tokens, which have no text
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t len;  // of the source
+  int32_t ret;   // of the parse
+  uint32_t is_module;
+  uint32_t count;  // tokens
+  uint32_t size;   // bytes of tokens after the header
+  uint64_t source;  // hash of the source, so a stream is never applied to other text of the same length
+} streamheader;
+
+typedef struct {
+  char *buf;  // source
+  uint8_t *data;
+  size_t size;
+  size_t cap;
+
+  uint32_t count;
+  uint32_t prev_end;
+  int prev_line_no;
+  int failed;  // out of memory, so the stream is incomplete
+} streamwriter;
+
+typedef struct {
+  const streamheader *header;
+  const uint8_t *at;
+  const uint8_t *end;
+  char *buf;        // source, or NULL to yield tokens without text
+  uint32_t offset;  // of the last token read, or STREAM__NO_P
+
+  uint32_t prev_end;
+  int prev_line_no;
+
+  void *map;  // if opened from a file
+  size_t map_size;
+} streamreader;
+
+// sets up w to encode tokens of buf
+void stream_writer_init(streamwriter *w, char *buf);
+
+// appends t to the streamwriter in arg, so may be passed to prsr_simple (nb. its id isn't kept, as
+// the side tables it refers to aren't)
+void stream_write(void *arg, token *t);
+
+// writes the stream to path, returns 0 or -1 on error (including a failed write)
+int stream_save(streamwriter *w, const char *path, int len, int is_module, int ret);
+
+// returns the stream as one new buffer (header and tokens) of *size bytes, e.g. to keep in memory,
+// or NULL on error (including a failed write)
+void *stream_finish(streamwriter *w, int len, int is_module, int ret, size_t *size);
+
+void stream_writer_free(streamwriter *w);
+
+// maps the stream at path to read it, returns 0 or -1 if it can't be read or isn't valid
+int stream_open(streamreader *r, const char *path, char *buf);
+
+// reads a stream already in memory, e.g. from a daemon (data must outlive r)
+int stream_from(streamreader *r, const void *data, size_t size, char *buf);
+
+// reads the next token into out (its p is NULL without a source, and its id is zero), returns 1 if
+// read, 0 at the end, or -1 if the stream is corrupt
+int stream_next(streamreader *r, token *out);
+
+// decodes every token without yielding any, returns 0 if the stream is valid (of this version, for
+// a source of len bytes, and if r has a source, for that exact text), so a later stream_replay
+// can't fail part of the way through (call before reading)
+int stream_check(streamreader *r, int len);
+
+// yields all remaining tokens to cb, returns the ret of the original parse, or ERROR__INTERNAL
+// if the stream is corrupt
+int stream_replay(streamreader *r, prsr_callback cb, void *arg);
+
+void stream_close(streamreader *r);
+
+#endif//_NATIVE_STREAM_H
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+// Writes the token stream of a file once, or reads it back for a later stage.
+// usage: ./native/run.sh tokens [-module] -o out.tok <file.js>
+//        ./native/run.sh tokens -read in.tok [file.js]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../parser.h"
+#include "file.h"
+#include "stream.h"
+#include "trace.h"
+
+static int write_stream(const char *path, const char *out, int is_module) {
+  int len;
+  char *buf = file_read(path, &len);
+  if (!buf) {
+    fprintf(stderr, "can't read: %s\n", path);
+    return 1;
+  }
+
+  uint64_t start = trace_now();
+  streamwriter w;
+  stream_writer_init(&w, buf);
+  tokendef td = prsr_init_token(buf);
+  int ret = prsr_simple(&td, is_module, stream_write, &w);
+  uint64_t took = trace_now() - start;
+
+  int err = stream_save(&w, out, len, is_module, ret);
+  if (err) {
+    fprintf(stderr, "can't write: %s\n", out);
+  } else {
+    fprintf(stderr, "ret=%d tokens=%u bytes=%d stream=%zu (%.2f bytes/token) in %.2fms\n",
+        ret, w.count, len, sizeof(streamheader) + w.size,
+        (double) w.size / (w.count ? w.count : 1), took / 1e6);
+  }
+  stream_writer_free(&w);
+  free(buf);
+  return err ? 1 : 0;
+}
+
+// reads every token, counting each type, as a stand-in for a later stage
+static int read_stream(const char *in, const char *path) {
+  int len = 0;
+  char *buf = NULL;
+  if (path && !(buf = file_read(path, &len))) {
+    fprintf(stderr, "can't read: %s\n", path);
+    return 1;
+  }
+
+  uint64_t start = trace_now();
+  streamreader r;
+  if (stream_open(&r, in, buf)) {
+    fprintf(stderr, "can't open stream: %s\n", in);
+    free(buf);
+    return 1;
+  }
+  if (buf && stream_check(&r, len)) {
+    // nb. checks the source's length and hash, so offsets are never applied to other text
+    if (r.header->len != (uint32_t) len) {
+      fprintf(stderr, "stream is for a different source (%u bytes, not %d)\n", r.header->len, len);
+    } else {
+      fprintf(stderr, "stream is for a different source, or corrupt\n");
+    }
+    stream_close(&r);
+    free(buf);
+    return 1;
+  }
+
+  int counts[32] = {0};
+  uint32_t count = 0;
+  token t;
+  int ok;
+  while ((ok = stream_next(&r, &t)) > 0) {
+    ++counts[t.type];
+    ++count;
+  }
+  uint64_t took = trace_now() - start;
+
+  if (ok < 0) {
+    fprintf(stderr, "stream is corrupt after %u tokens\n", count);
+  } else {
+    printf("ret=%d tokens=%u module=%u in %.2fms\n", r.header->ret, count, r.header->is_module,
+        took / 1e6);
+    for (int i = 0; i < 32; ++i) {
+      if (counts[i]) {
+        printf("type %2d: %d\n", i, counts[i]);
+      }
+    }
+  }
+  stream_close(&r);
+  free(buf);
+  return ok < 0 ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+  int is_module = 0;
+  const char *out = NULL;
+  const char *in = NULL;
+  const char *path = NULL;
+  for (int i = 1; i < argc; ++i) {
+    char *arg = argv[i];
+    int has_value = (i + 1 < argc);
+    if (!strcmp(arg, "-module")) {
+      is_module = 1;
+    } else if (!strcmp(arg, "-o") && has_value) {
+      out = argv[++i];
+    } else if (!strcmp(arg, "-read") && has_value) {
+      in = argv[++i];
+    } else if (arg[0] != '-' && !path) {
+      path = arg;
+    } else {
+      in = out = NULL;
+      break;
+    }
+  }
+
+  if (in && !out) {
+    return read_stream(in, path);
+  } else if (out && !in && path) {
+    return write_stream(path, out, is_module);
+  }
+  fprintf(stderr, "usage: %s [-module] -o out.tok <file.js>\n"
+      "       %s -read in.tok [file.js]\n", argv[0], argv[0]);
+  return 1;
+}
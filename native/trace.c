@@ -0,0 +1,91 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "trace.h"
+
+uint64_t trace_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void trace_span(tracebuf *t, const char *name, const char *file, uint64_t start, uint64_t end) {
+  if (!t) {
+    return;
+  }
+  if (t->count == t->cap) {
+    t->cap = t->cap ? t->cap * 2 : 1024;
+    t->events = realloc(t->events, sizeof(traceevent) * t->cap);
+  }
+  traceevent *e = &(t->events[t->count++]);
+  e->name = name;
+  e->file = file;
+  e->start = start;
+  e->end = end;
+}
+
+static void write_escaped(FILE *f, const char *s) {
+  for (; *s; ++s) {
+    unsigned char c = *s;
+    if (c == '"' || c == '\\') {
+      fprintf(f, "\\%c", c);
+    } else if (c < 0x20) {
+      fprintf(f, "\\u%04x", c);
+    } else {
+      fputc(c, f);
+    }
+  }
+}
+
+int trace_write(const char *path, tracebuf *bufs, int count, uint64_t origin) {
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    return -1;
+  }
+
+  fprintf(f, "{\"traceEvents\":[\n");
+  int first = 1;
+  for (int i = 0; i < count; ++i) {
+    tracebuf *t = &bufs[i];
+    fprintf(f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,"
+        "\"args\":{\"name\":\"worker %d\"}}", first ? "" : ",\n", t->tid, t->tid);
+    first = 0;
+
+    for (int j = 0; j < t->count; ++j) {
+      traceevent *e = &(t->events[j]);
+      fprintf(f, ",\n{\"ph\":\"X\",\"name\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+          e->name, t->tid, (e->start - origin) / 1e3, (e->end - e->start) / 1e3);
+      if (e->file) {
+        fprintf(f, ",\"args\":{\"file\":\"");
+        write_escaped(f, e->file);
+        fprintf(f, "\"}");
+      }
+      fprintf(f, "}");
+    }
+  }
+  fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+  return fclose(f) ? -1 : 0;
+}
+
+void trace_free(tracebuf *t) {
+  free(t->events);
+  t->events = NULL;
+  t->count = t->cap = 0;
+}
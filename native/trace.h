@@ -0,0 +1,50 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+#include <stdint.h>
+
+#ifndef _NATIVE_TRACE_H
+#define _NATIVE_TRACE_H
+
+// A single span. Names are not copied, so must outlive the tracebuf.
+typedef struct {
+  const char *name;
+  const char *file;
+  uint64_t start;  // ns
+  uint64_t end;    // ns
+} traceevent;
+
+// Spans recorded by one thread, so no locking is needed.
+typedef struct {
+  traceevent *events;
+  int count;
+  int cap;
+  int tid;
+} tracebuf;
+
+// returns CLOCK_MONOTONIC in ns
+uint64_t trace_now();
+
+// records a span on t, which may be NULL to record nothing
+void trace_span(tracebuf *t, const char *name, const char *file, uint64_t start, uint64_t end);
+
+// writes all spans as Chrome trace-event JSON (for chrome://tracing or Perfetto), with times
+// relative to origin, returns 0 or -1 on error
+int trace_write(const char *path, tracebuf *bufs, int count, uint64_t origin);
+
+void trace_free(tracebuf *t);
+
+#endif//_NATIVE_TRACE_H
@@ -0,0 +1,566 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+#include <string.h>
+#include "number.h"
+#include "tokens/pow10.h"
+
+#define NUMBER__MANTISSA_BITS 52
+#define NUMBER__EXP_BIAS      1023
+#define NUMBER__INF_BITS      0x7ff0000000000000ULL
+#define NUMBER__MAX_EXP       100000  // larger exponents are all zero or infinity
+#define NUMBER__DIGITS        800     // kept by the slow path, as any more can't change rounding
+#define NUMBER__MAX_SHIFT     60      // bits per shift of the slow path, so digits fit in 64 bits
+
+void prsr_numbers_init(prsr_numbers *n, prsr_number *all, int max) {
+  bzero(n, sizeof(prsr_numbers));
+  n->all = all;
+  n->max = max;
+}
+
+static inline double from_bits(uint64_t bits) {
+  double out;
+  memcpy(&out, &bits, sizeof(out));
+  return out;
+}
+
+static inline int is_digit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+static inline int digit_value(char c) {
+  if (is_digit(c)) {
+    return c - '0';
+  }
+  c |= 0x20;  // lowercase
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return 16;
+}
+
+// returns m * 2^e2 (with m non-zero), rounded to even, where sticky is set if lower non-zero bits
+// were dropped from m
+static double scale_binary(uint64_t m, int e2, int sticky) {
+  int clz = __builtin_clzll(m);
+  m <<= clz;
+  int exp = e2 - clz + 63;
+
+  uint64_t mant = m >> 11;
+  uint64_t rest = m & 0x7ff;
+  if (rest > 0x400 || (rest == 0x400 && (sticky || (mant & 1)))) {
+    ++mant;
+    if (mant >> 53) {
+      mant >>= 1;
+      ++exp;
+    }
+  }
+  if (exp >= NUMBER__EXP_BIAS + 1) {
+    return from_bits(NUMBER__INF_BITS);
+  }
+  mant &= (1ULL << NUMBER__MANTISSA_BITS) - 1;
+  return from_bits((uint64_t) (exp + NUMBER__EXP_BIAS) << NUMBER__MANTISSA_BITS | mant);
+}
+
+// parses the digits of a "0x", "0o" or "0b" literal (after its prefix), of shift bits each
+static int parse_radix(char *p, char *end, int shift, prsr_number *out) {
+  int flags = 0;
+  if (end > p && end[-1] == 'n') {
+    flags |= NUMBER__BIGINT;
+    --end;
+  }
+
+  uint64_t m = 0;
+  int e2 = 0;
+  int sticky = 0;
+  int prev_digit = 0;
+  for (; p < end; ++p) {
+    if (*p == '_') {
+      if (!prev_digit) {
+        flags |= NUMBER__INVALID;  // leading or doubled separator
+      }
+      prev_digit = 0;
+      continue;
+    }
+    uint64_t v = digit_value(*p);
+    if (v >> shift) {
+      flags |= NUMBER__INVALID;
+      prev_digit = 0;
+      continue;
+    }
+    prev_digit = 1;
+
+    if (m >> (64 - shift)) {
+      // keep the top bits only: BigInts wrap, and there's more than enough left to round a double
+      if (flags & NUMBER__BIGINT) {
+        flags |= NUMBER__WRAPPED;
+      } else {
+        e2 += shift;
+        sticky |= (v != 0);
+        continue;
+      }
+    }
+    m = (m << shift) | v;
+  }
+  if (!prev_digit) {
+    flags |= NUMBER__INVALID;  // no digits, or trailing separator
+  }
+
+  if (flags & NUMBER__BIGINT) {
+    out->bigint = m;
+  } else {
+    out->value = m ? scale_binary(m, e2, sticky) : 0.0;
+  }
+  return flags;
+}
+
+// finds m * 10^exp10 (with m non-zero) as per Eisel and Lemire, "Number Parsing at a Gigabyte per
+// Second", returns 0 if the result can't be rounded exactly this way (including subnormals)
+static int eisel_lemire(uint64_t m, int exp10, double *out) {
+  if (exp10 < POW10__MIN_EXP10 || exp10 > POW10__MAX_EXP10) {
+    return 0;
+  }
+  int clz = __builtin_clzll(m);
+  m <<= clz;
+  uint64_t exp2 = (uint64_t) (((217706 * exp10) >> 16) + 64 + NUMBER__EXP_BIAS) - clz;
+
+  // multiply by the high half of the power, then the low half only if the result is ambiguous
+  const uint64_t *pow = pow10_table[exp10 - POW10__MIN_EXP10];
+  unsigned __int128 x = (unsigned __int128) m * pow[1];
+  uint64_t hi = x >> 64;
+  uint64_t lo = (uint64_t) x;
+  if ((hi & 0x1ff) == 0x1ff && lo + m < m) {
+    unsigned __int128 y = (unsigned __int128) m * pow[0];
+    uint64_t merged_hi = hi;
+    uint64_t merged_lo = lo + (uint64_t) (y >> 64);
+    if (merged_lo < lo) {
+      ++merged_hi;
+    }
+    if ((merged_hi & 0x1ff) == 0x1ff && merged_lo + 1 == 0 && (uint64_t) y + m < m) {
+      return 0;
+    }
+    hi = merged_hi;
+    lo = merged_lo;
+  }
+
+  // shift to 54 bits, then round to 53
+  uint64_t msb = hi >> 63;
+  uint64_t mant = hi >> (msb + 9);
+  exp2 -= 1 ^ msb;
+  if (lo == 0 && (hi & 0x1ff) == 0 && (mant & 3) == 1) {
+    return 0;  // exactly halfway, but the power was rounded down
+  }
+  mant += mant & 1;
+  mant >>= 1;
+  if (mant >> 53) {
+    mant >>= 1;
+    ++exp2;
+  }
+  if (exp2 - 1 >= 0x7ff - 1) {
+    return 0;  // subnormal or infinite
+  }
+  *out = from_bits(exp2 << NUMBER__MANTISSA_BITS | (mant & ((1ULL << NUMBER__MANTISSA_BITS) - 1)));
+  return 1;
+}
+
+// The slow path: a decimal of up to NUMBER__DIGITS digits (0.d[0]d[1]... * 10^dp), scaled by
+// powers of two until its integer part is the mantissa (after Go's strconv).
+typedef struct {
+  uint8_t d[NUMBER__DIGITS];
+  int nd;
+  int dp;
+  int trunc;  // non-zero digits were dropped
+} bigdecimal;
+
+static void decimal_trim(bigdecimal *a) {
+  while (a->nd > 0 && a->d[a->nd - 1] == 0) {
+    --a->nd;
+  }
+  if (!a->nd) {
+    a->dp = 0;
+  }
+}
+
+static void decimal_left(bigdecimal *a, int k) {
+  // each pass adds at most 19 digits, written backwards from the end
+  uint8_t tmp[NUMBER__DIGITS + 20];
+  int w = sizeof(tmp);
+  uint64_t n = 0;
+  for (int r = a->nd - 1; r >= 0; --r) {
+    n += (uint64_t) a->d[r] << k;
+    uint64_t quo = n / 10;
+    tmp[--w] = n - quo * 10;
+    n = quo;
+  }
+  while (n) {
+    uint64_t quo = n / 10;
+    tmp[--w] = n - quo * 10;
+    n = quo;
+  }
+
+  int count = sizeof(tmp) - w;
+  a->dp += count - a->nd;
+  if (count > NUMBER__DIGITS) {
+    for (int i = w + NUMBER__DIGITS; i < (int) sizeof(tmp); ++i) {
+      a->trunc |= (tmp[i] != 0);
+    }
+    count = NUMBER__DIGITS;
+  }
+  memcpy(a->d, tmp + w, count);
+  a->nd = count;
+  decimal_trim(a);
+}
+
+static void decimal_right(bigdecimal *a, int k) {
+  int r = 0;
+  int w = 0;
+  uint64_t n = 0;
+  uint64_t mask = (1ULL << k) - 1;
+
+  // pick up enough leading digits to cover the first shift
+  for (; !(n >> k); ++r) {
+    if (r >= a->nd) {
+      if (!n) {
+        a->nd = 0;
+        return;
+      }
+      while (!(n >> k)) {
+        n *= 10;
+        ++r;
+      }
+      break;
+    }
+    n = n * 10 + a->d[r];
+  }
+  a->dp -= r - 1;
+
+  // pick up a digit, put down a digit
+  for (; r < a->nd; ++r) {
+    a->d[w++] = n >> k;
+    n = (n & mask) * 10 + a->d[r];
+  }
+
+  // put down the rest
+  while (n) {
+    uint64_t dig = n >> k;
+    n &= mask;
+    if (w < NUMBER__DIGITS) {
+      a->d[w++] = dig;
+    } else if (dig) {
+      a->trunc = 1;
+    }
+    n *= 10;
+  }
+  a->nd = w;
+  decimal_trim(a);
+}
+
+// multiplies by 2^k (or divides, if negative)
+static void decimal_shift(bigdecimal *a, int k) {
+  if (!a->nd) {
+    return;
+  }
+  for (; k > NUMBER__MAX_SHIFT; k -= NUMBER__MAX_SHIFT) {
+    decimal_left(a, NUMBER__MAX_SHIFT);
+  }
+  for (; k < -NUMBER__MAX_SHIFT; k += NUMBER__MAX_SHIFT) {
+    decimal_right(a, NUMBER__MAX_SHIFT);
+  }
+  if (k > 0) {
+    decimal_left(a, k);
+  } else if (k < 0) {
+    decimal_right(a, -k);
+  }
+}
+
+// returns the integer part of a, rounded to even
+static uint64_t decimal_round(bigdecimal *a) {
+  uint64_t n = 0;
+  int i = 0;
+  for (; i < a->dp && i < a->nd; ++i) {
+    n = n * 10 + a->d[i];
+  }
+  for (; i < a->dp; ++i) {
+    n *= 10;
+  }
+
+  int at = a->dp;
+  if (at >= 0 && at < a->nd) {
+    if (a->d[at] == 5 && at + 1 == a->nd) {
+      // exactly halfway, unless digits were dropped
+      n += a->trunc || (at > 0 && (a->d[at - 1] & 1));
+    } else {
+      n += (a->d[at] >= 5);
+    }
+  }
+  return n;
+}
+
+static double decimal_value(bigdecimal *a) {
+  static const int powtab[] = {1, 3, 6, 9, 13, 16, 19, 23, 26};
+  const int powtab_size = sizeof(powtab) / sizeof(powtab[0]);
+  const int bias = -NUMBER__EXP_BIAS;
+
+  if (!a->nd || a->dp < -330) {
+    return 0.0;
+  } else if (a->dp > 310) {
+    return from_bits(NUMBER__INF_BITS);
+  }
+
+  // scale by powers of two until in [0.5, 1)
+  int exp = 0;
+  while (a->dp > 0) {
+    int n = a->dp >= powtab_size ? 27 : powtab[a->dp];
+    decimal_shift(a, -n);
+    exp += n;
+  }
+  while (a->dp < 0 || (a->dp == 0 && a->d[0] < 5)) {
+    int n = -a->dp >= powtab_size ? 27 : powtab[-a->dp];
+    decimal_shift(a, n);
+    exp -= n;
+  }
+  --exp;  // doubles are in [1, 2)
+
+  // subnormals have the smallest exponent, and fewer bits
+  if (exp < bias + 1) {
+    int n = bias + 1 - exp;
+    decimal_shift(a, -n);
+    exp += n;
+  }
+  if (exp - bias >= 0x7ff) {
+    return from_bits(NUMBER__INF_BITS);
+  }
+
+  decimal_shift(a, 1 + NUMBER__MANTISSA_BITS);
+  uint64_t mant = decimal_round(a);
+  if (mant == (2ULL << NUMBER__MANTISSA_BITS)) {
+    mant >>= 1;  // rounding carried
+    ++exp;
+    if (exp - bias >= 0x7ff) {
+      return from_bits(NUMBER__INF_BITS);
+    }
+  }
+  if (!(mant & (1ULL << NUMBER__MANTISSA_BITS))) {
+    exp = bias;  // subnormal
+  }
+  mant &= (1ULL << NUMBER__MANTISSA_BITS) - 1;
+  return from_bits((uint64_t) ((exp - bias) & 0x7ff) << NUMBER__MANTISSA_BITS | mant);
+}
+
+// reads every digit of the mantissa between p and end (already checked to be valid)
+static double slow_decimal(char *p, char *end, int exp10) {
+  bigdecimal a;
+  a.nd = 0;
+  a.dp = 0;
+  a.trunc = 0;
+
+  int dot = 0;
+  for (; p < end; ++p) {
+    char c = *p;
+    if (c == '.') {
+      dot = 1;
+    } else if (!is_digit(c)) {
+      continue;  // separators
+    } else if (c == '0' && !a.nd) {
+      a.dp -= dot;  // leading zero
+    } else {
+      a.dp += !dot;
+      if (a.nd < NUMBER__DIGITS) {
+        a.d[a.nd++] = c - '0';
+      } else if (c != '0') {
+        a.trunc = 1;
+      }
+    }
+  }
+  a.dp += exp10;
+  decimal_trim(&a);
+  return decimal_value(&a);
+}
+
+// returns w * 10^exp10 (from digits significant digits, or more if trunc), rounded exactly, where
+// the mantissa is between p and end and followed by exponent exp
+static double decimal_to_double(uint64_t w, int digits, int exp10, int trunc, char *p, char *end,
+    int exp) {
+  static const double small[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+    1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+  };
+
+  if (!w) {
+    return 0.0;
+  } else if (exp10 + digits - 1 > 308) {
+    return from_bits(NUMBER__INF_BITS);
+  } else if (exp10 + digits < -324) {
+    return 0.0;
+  }
+
+  // exact when both w and 10^exp10 are (Clinger's fast path)
+  if (!trunc && w <= (1ULL << 53) && exp10 >= -22 && exp10 <= 22) {
+    return exp10 < 0 ? (double) w / small[-exp10] : (double) w * small[exp10];
+  }
+
+  double out;
+  if (eisel_lemire(w, exp10, &out)) {
+    // with digits dropped, the value is between w and w+1, so must round the same for both
+    double upper;
+    if (!trunc || (eisel_lemire(w + 1, exp10, &upper) && upper == out)) {
+      return out;
+    }
+  }
+  return slow_decimal(p, end, exp);
+}
+
+// parses a decimal literal, including legacy octal and BigInt
+static int parse_decimal(char *p, char *end, prsr_number *out) {
+  int flags = 0;
+  char *start = p;
+  if (end > p && end[-1] == 'n') {
+    flags |= NUMBER__BIGINT;
+    --end;
+  }
+
+  // "017" is octal, but "018" (and "018.5") decimal: neither allows separators or "n", and as
+  // "07.5" is "07" then ".5", only the decimal form may go on
+  if (end - p > 1 && p[0] == '0' && is_digit(p[1])) {
+    flags |= NUMBER__LEGACY;
+    if (flags & NUMBER__BIGINT) {
+      flags = (flags & ~NUMBER__BIGINT) | NUMBER__INVALID;
+    }
+    int octal = 1;
+    char *at = p;
+    for (; at < end && (is_digit(*at) || *at == '_'); ++at) {
+      if (*at == '_') {
+        flags |= NUMBER__INVALID;
+      } else if (*at > '7') {
+        octal = 0;
+      }
+    }
+    if (octal && at == end) {
+      return flags | parse_radix(p, end, 3, out);
+    } else if (octal) {
+      flags |= NUMBER__INVALID;  // value is a guess as decimal
+    }
+  }
+
+  uint64_t w = 0;
+  uint64_t bigint = 0;
+  int digits = 0;  // in w, from the first non-zero digit
+  int exp10 = 0;
+  int trunc = 0;
+  int dot = 0;
+  int exp = 0;
+
+  for (; p < end; ++p) {
+    char c = *p;
+    if (is_digit(c)) {
+      int v = c - '0';
+      if (!w && !v) {
+        exp10 -= dot;  // leading zero
+      } else if (digits < 19) {
+        w = w * 10 + v;
+        ++digits;
+        exp10 -= dot;
+      } else {
+        exp10 += !dot;
+        trunc |= v;
+      }
+      if ((flags & NUMBER__BIGINT) &&
+          (__builtin_mul_overflow(bigint, 10, &bigint) | __builtin_add_overflow(bigint, v, &bigint))) {
+        flags |= NUMBER__WRAPPED;
+      }
+    } else if (c == '_') {
+      // only between two digits, and not after a leading zero ("0_1")
+      if (p == start || !is_digit(p[-1]) || p + 1 >= end || !is_digit(p[1]) ||
+          (p - 1 == start && *start == '0')) {
+        flags |= NUMBER__INVALID;
+      }
+    } else if (c == '.' && !dot) {
+      dot = 1;
+    } else {
+      break;
+    }
+  }
+  if (p == start || (p - start == 1 && dot)) {
+    flags |= NUMBER__INVALID;  // no digits
+  }
+  char *mantissa_end = p;
+
+  // optional exponent, e.g. "e-5"
+  if (p < end && (*p | 0x20) == 'e') {
+    ++p;
+    int sign = 1;
+    if (p < end && (*p == '+' || *p == '-')) {
+      sign = (*p == '-') ? -1 : 1;
+      ++p;
+    }
+    char *exp_start = p;
+    for (; p < end; ++p) {
+      if (is_digit(*p)) {
+        if (exp < NUMBER__MAX_EXP) {
+          exp = exp * 10 + (*p - '0');
+        }
+      } else if (*p == '_' && p > exp_start && is_digit(p[-1]) && p + 1 < end && is_digit(p[1])) {
+        // separator
+      } else {
+        break;
+      }
+    }
+    if (p == exp_start) {
+      flags |= NUMBER__INVALID;
+    }
+    exp *= sign;
+    exp10 += exp;
+    dot = 1;  // for BigInt, below
+  }
+  if (p != end) {
+    flags |= NUMBER__INVALID;  // trailing junk, e.g. "1a"
+  }
+
+  if (flags & NUMBER__BIGINT) {
+    if (dot || (flags & NUMBER__LEGACY)) {
+      flags |= NUMBER__INVALID;  // "1.5n", "1e3n", "08n"
+    }
+    out->bigint = bigint;
+    return flags;
+  }
+  out->value = decimal_to_double(w, digits, exp10, trunc, start, mantissa_end, exp);
+  return flags;
+}
+
+int prsr_number_value(char *p, int len, prsr_number *out) {
+  bzero(out, sizeof(prsr_number));
+  char *end = p + len;
+
+  if (len > 2 && p[0] == '0') {
+    char c = p[1] | 0x20;
+    int shift = (c == 'x') ? 4 : (c == 'o') ? 3 : (c == 'b') ? 1 : 0;
+    if (shift) {
+      out->flags = parse_radix(p + 2, end, shift, out);
+      return out->flags;
+    }
+  }
+  out->flags = parse_decimal(p, end, out);
+  return out->flags;
+}
+
+uint32_t prsr_decode_number(prsr_numbers *n, char *p, int len) {
+  if (n->count == n->max || n->count == NUMBER__MAX_ID) {
+    n->full = 1;
+    return 0;
+  }
+  prsr_number_value(p, len, &n->all[n->count]);
+  return ++n->count;
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+#include <stdint.h>
+
+#ifndef _NUMBER_H
+#define _NUMBER_H
+
+#define NUMBER__MAX_ID ((1 << 24) - 1)  // ids must fit in token.id
+
+#define NUMBER__INVALID 1  // not a valid literal, value is a best guess
+#define NUMBER__BIGINT  2  // ends with "n", so bigint is set instead of value
+#define NUMBER__LEGACY  4  // legacy octal "017" or decimal "08", invalid in strict mode
+#define NUMBER__WRAPPED 8  // a BigInt wider than 64 bits, bigint holds its low bits
+
+typedef struct {
+  union {
+    double value;
+    uint64_t bigint;
+  };
+  uint32_t flags;
+} prsr_number;
+
+// Decoded values of number literals, in memory owned by the caller. Floats are rounded exactly
+// (as per JS), without strtod or the current locale. One entry per two bytes of source (but at
+// most NUMBER__MAX_ID) only runs out once ids would no longer fit.
+typedef struct {
+  prsr_number *all;
+  uint32_t count;
+  uint32_t max;
+
+  int full;  // set once out of room, after which values aren't decoded
+} prsr_numbers;
+
+// sets up n to decode into all (of max entries)
+void prsr_numbers_init(prsr_numbers *n, prsr_number *all, int max);
+
+// decodes the number literal of len bytes at p into out, returns its flags
+int prsr_number_value(char *p, int len, prsr_number *out);
+
+// decodes the number literal of len bytes at p, returns its index in n->all plus one, or zero if
+// n is full
+uint32_t prsr_decode_number(prsr_numbers *n, char *p, int len);
+
+#endif//_NUMBER_H
@@ -0,0 +1,25 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+#include <string.h>
+#include "pairs.h"
+
+void prsr_pairs_init(prsr_pairs *p, uint32_t *close, int max) {
+  bzero(p, sizeof(prsr_pairs));
+  p->close = close;
+  p->max = max;
+  memset(close, 0, sizeof(uint32_t) * max);
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+#include <stdint.h>
+#include "types.h"
+
+#ifndef _PAIRS_H
+#define _PAIRS_H
+
+// Links each open token ("(", "[", "{", "${" or "?") to its close, by source offset (from the
+// tokendef's buf), so any token seen via prsr_next_token or prsr_simple can be looked up directly.
+// One entry per byte of source can never run out.
+typedef struct {
+  uint32_t *close;  // by offset: the offset of its close, or zero if not an open (or unclosed)
+  uint32_t max;
+
+  int full;  // set if an open was past max, so wasn't recorded
+  uint32_t open[__STACK_SIZE];  // offset of each open group, by tokendef depth
+} prsr_pairs;
+
+// sets up p to record into close (of max entries, which are zeroed)
+void prsr_pairs_init(prsr_pairs *p, uint32_t *close, int max);
+
+#endif//_PAIRS_H
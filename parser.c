@@ -19,32 +19,16 @@
 #define debugf (void)sizeof
 #endif
 
-
-typedef struct {
-  token prev;           // previous token
-  uint32_t start;       // hash of stype start (set only for some stypes)
-  uint8_t stype : 3;    // stack type
-  uint8_t context : 3;  // current execution context (strict, async, generator)
-} sstack;
-
-
-typedef struct {
-  tokendef *td;
-  token *next;  // convenience
-  token tok;
-  int is_module;
-
-  prsr_callback cb;
-  void *arg;
-  int prev_line_no;
-
-  sstack *curr;
-  sstack stack[__STACK_SIZE];
-} simpledef;
+#ifdef PRSR_STATS
+#define _stat(sd, field) (++(sd)->stats.field)
+#else
+#define _stat(sd, field)
+#endif
 
 
 static sstack *stack_inc(simpledef *sd, uint8_t stype) {
   // TODO: check bounds
+  _stat(sd, push[stype]);
   ++sd->curr;
   bzero(sd->curr, sizeof(sstack));
   sd->curr->stype = stype;
@@ -53,8 +37,110 @@ static sstack *stack_inc(simpledef *sd, uint8_t stype) {
 }
 
 
+// closes open nodes at or above depth, which were popped without their close
+static void outline_unwind(prsr_outline *o, int depth, uint32_t end) {
+  while (o->open >= 0 && o->all[o->open].depth >= depth) {
+    prsr_outline_node *n = o->all + o->open;
+    n->end = end;
+    o->open = n->parent;
+  }
+}
+
+
+// records a node for the stack entry just pushed
+static void outline_open(simpledef *sd, int type, char *start) {
+  prsr_outline *o = sd->outline;
+  if (!o) {
+    return;
+  }
+  int depth = sd->curr - sd->stack;
+  outline_unwind(o, depth, start - sd->td->buf);
+  if (o->full || o->count == o->max) {
+    o->full = 1;
+    return;
+  }
+
+  prsr_outline_node *n = o->all + o->count;
+  n->start = start - sd->td->buf;
+  n->end = 0;
+  n->parent = o->open;
+  n->type = type;
+  n->depth = depth;
+  o->open = o->count++;
+}
+
+
+// closes the node of the current stack entry (if any) at sd->tok, its close
+static void outline_close(simpledef *sd) {
+  prsr_outline *o = sd->outline;
+  if (!o) {
+    return;
+  }
+  int depth = sd->curr - sd->stack;
+  outline_unwind(o, depth + 1, sd->tok.p - sd->td->buf);
+  if (o->open >= 0 && o->all[o->open].depth == depth) {
+    outline_unwind(o, depth, sd->tok.p + sd->tok.len - sd->td->buf);
+  }
+}
+
+
+// forgets the node of the current stack entry (a function or class that wasn't), leaving it with
+// no type until outline_compact moves its children up to its parent
+static void outline_drop(simpledef *sd) {
+  prsr_outline *o = sd->outline;
+  if (!o) {
+    return;
+  }
+  int depth = sd->curr - sd->stack;
+  outline_unwind(o, depth + 1, sd->tok.p - sd->td->buf);
+  if (o->open < 0 || o->all[o->open].depth != depth) {
+    return;
+  }
+
+  prsr_outline_node *n = o->all + o->open;
+  n->type = 0;
+  o->open = n->parent;
+}
+
+
+// removes dropped nodes once parsing is done, pointing their children at their own parents
+static void outline_compact(prsr_outline *o) {
+  int from[__STACK_SIZE];  // index of the last node seen at each depth
+  int to[__STACK_SIZE];    // ... and where it moved (or its parent's, if dropped)
+  int count = 0;
+  memset(from, -1, sizeof(from));
+
+  for (int i = 0; i < o->count; ++i) {
+    prsr_outline_node n = o->all[i];
+    int parent = n.parent;
+    if (parent >= 0) {
+      // nb. the parent is always the last node seen at some lower depth
+      int d = n.depth - 1;
+      while (from[d] != parent) {
+        --d;
+      }
+      parent = to[d];
+    }
+
+    from[n.depth] = i;
+    if (!n.type) {
+      to[n.depth] = parent;
+      continue;
+    }
+    to[n.depth] = count;
+    n.parent = parent;
+    o->all[count++] = n;
+  }
+  o->count = count;
+}
+
+
 // stores a virtual token in the stream, and yields it before the current token
 static void yield_virt(simpledef *sd, int type) {
+  _stat(sd, virt);
+  if (type == TOKEN_SEMICOLON) {
+    _stat(sd, virt_asi);
+  }
   token *t = &(sd->curr->prev);
   bzero(t, sizeof(token));
 
@@ -66,6 +152,7 @@ static void yield_virt(simpledef *sd, int type) {
 
 
 static void yield_virt_skip(simpledef *sd, int type) {
+  _stat(sd, virt);
   token t;
   bzero(&t, sizeof(token));
 
@@ -105,6 +192,9 @@ static int skip_walk(simpledef *sd, int has_value) {
     sd->prev_line_no = sd->tok.line_no;
     sd->cb(sd->arg, &(sd->tok));
   }
+  if (sd->td->next.type == TOKEN_SLASH) {
+    _stat(sd, slash);
+  }
   for (;;) {
     // prsr_next_token can reveal comments, loop until over them
     int out = prsr_next_token(sd->td, &(sd->tok), has_value);
@@ -123,6 +213,31 @@ static int record_walk(simpledef *sd, int has_value) {
 }
 
 
+// skips a function body after its "{" (in sd->tok, as TOKEN_EXEC), yielding it as one TOKEN_BODY,
+// then continues in its block as if it were empty
+static void skip_body(simpledef *sd, uint8_t context) {
+  token *open = &(sd->tok);
+  sd->curr->prev = *open;
+  sd->prev_line_no = open->line_no;
+  sd->cb(sd->arg, open);
+
+  token body;
+  bzero(&body, sizeof(token));
+  body.p = open->p + open->len;
+  body.line_no = open->line_no;
+  body.type = TOKEN_BODY;
+  body.hash = context;
+  prsr_skip_group(sd->td, NULL, NULL);  // nb. if unclosed, the block fails at EOF
+  body.len = sd->next->p - body.p;
+  sd->cb(sd->arg, &body);
+
+  stack_inc(sd, SSTACK__BLOCK);
+  sd->curr->prev.type = TOKEN_TOP;
+  sd->curr->context = context;
+  prsr_next_token(sd->td, &(sd->tok), -1);  // the close
+}
+
+
 static int is_optional_keyword(uint32_t hash, uint8_t context) {
   if (context & CONTEXT__ASYNC && hash == LIT_AWAIT) {
     return 1;
@@ -232,11 +347,14 @@ static int match_class(simpledef *sd) {
 
 
 static int enact_defn(simpledef *sd) {
+  char *start = sd->tok.p;
+
   // ...match function
   int context = match_function(sd);
   if (context >= 0) {
     stack_inc(sd, SSTACK__FUNC);
     sd->curr->context = context;
+    outline_open(sd, OUTLINE__FUNC, start);
     return 1;
   }
 
@@ -244,6 +362,7 @@ static int enact_defn(simpledef *sd) {
   int class = match_class(sd);
   if (class >= 0) {
     stack_inc(sd, SSTACK__CLASS);
+    outline_open(sd, OUTLINE__CLASS, start);
     return 1;
   }
 
@@ -274,14 +393,6 @@ static int match_label_keyword(simpledef *sd) {
 }
 
 
-static int is_use_strict(token *t) {
-  if (t->type != TOKEN_STRING || t->len != 12) {
-    return 0;
-  }
-  return !memcmp(t->p, "'use strict'", 12) || !memcmp(t->p, "\"use strict\"", 12);
-}
-
-
 // is the next token valuelike for a previous valuelike?
 // used directly only for "let" and "await" (at top-level), so doesn't include e.g. paren or array,
 // as these would be indexing or calling
@@ -386,11 +497,18 @@ static int simple_start_arrowfunc(simpledef *sd, int async) {
   if (sd->next->type == TOKEN_BRACE) {
     // the sensible arrow function case, with a proper body
     // e.g. "() => { statements }"
+    char *start = sd->tok.p;
     record_walk(sd, -1);  // consume =>
     sd->tok.type = TOKEN_EXEC;
+    if (sd->preparse) {
+      skip_body(sd, context);
+      outline_open(sd, OUTLINE__FUNC, start);
+      return 0;
+    }
     record_walk(sd, -1);  // consume {
     stack_inc(sd, SSTACK__BLOCK);
     sd->curr->prev.type = TOKEN_TOP;
+    outline_open(sd, OUTLINE__FUNC, start);
   } else {
     // just change statement's context (e.g. () => async () => () => ...)
     record_walk(sd, -1);  // consume =>
@@ -487,6 +605,7 @@ static int simple_consume_expr(simpledef *sd) {
       sd->tok.type = TOKEN_DICT;
       record_walk(sd, -1);
       stack_inc(sd, SSTACK__DICT);
+      outline_open(sd, OUTLINE__DICT, (sd->curr - 1)->prev.p);
       return 0;
 
     case TOKEN_TERNARY:
@@ -745,6 +864,7 @@ static int simple_consume(simpledef *sd) {
           token *yield = &((sd->curr - 1)->prev);
           yield->type = (sd->tok.type == TOKEN_ARROW ? TOKEN_KEYWORD : TOKEN_SYMBOL);
           yield->mark = MARK_RESOLVE;
+          _stat(sd, async_resolve);
           sd->cb(sd->arg, yield);
           break;
         }
@@ -815,6 +935,7 @@ finalize_module:
           if (sd->tok.type == TOKEN_STRING) {
             // this ends import, ensure "... 'foo' /123/" is regexp
             prsr_close_op_next(sd->td);
+            _stat(sd, close_op_next);
             record_walk(sd, 0);
           }
 
@@ -859,6 +980,7 @@ abandon_module:
     // dict state (left)
     case SSTACK__DICT: {
       uint8_t context = 0;
+      char *start = sd->tok.p;
 
       // search for function
       // ... look for 'static' without '(' next
@@ -905,6 +1027,7 @@ abandon_module:
           debugf("pretending to be function: %.*s\n", sd->tok.len, sd->tok.p);
           stack_inc(sd, SSTACK__FUNC);
           sd->curr->context = context;
+          outline_open(sd, OUTLINE__FUNC, start);
           return 0;
 
         case TOKEN_COLON:
@@ -914,6 +1037,7 @@ abandon_module:
           return 0;
 
         case TOKEN_CLOSE:
+          outline_close(sd);
           --sd->curr;
           debugf("closing dict, value=%d level=%ld\n", sd->curr->stype == SSTACK__EXPR, sd->curr - sd->stack);
           skip_walk(sd, sd->curr->stype == SSTACK__EXPR);
@@ -977,6 +1101,10 @@ abandon_module:
           uint8_t context = sd->curr->context;
           --sd->curr;
           sd->tok.type = TOKEN_EXEC;
+          if (sd->preparse) {
+            skip_body(sd, context);
+            return 0;
+          }
           record_walk(sd, -1);
           stack_inc(sd, SSTACK__BLOCK);
           sd->curr->prev.type = TOKEN_TOP;
@@ -987,6 +1115,7 @@ abandon_module:
 
       // invalid, abandon function def
       debugf("invalid function construct\n");
+      outline_drop(sd);
       --sd->curr;
       return 0;
 
@@ -1012,6 +1141,7 @@ abandon_module:
 
       // invalid, abandon class def
       debugf("invalid class construct\n");
+      outline_drop(sd);
       --sd->curr;
       return 0;
     }
@@ -1088,6 +1218,7 @@ check_single_block:
         sd->tok.type = TOKEN_EXEC;
         record_walk(sd, -1);
         stack_inc(sd, SSTACK__BLOCK);
+        outline_open(sd, OUTLINE__BLOCK, (sd->curr - 1)->prev.p);
       } else {
         // ... found e.g. "if something_else", push virtual exec block
         yield_virt(sd, TOKEN_EXEC);
@@ -1125,6 +1256,7 @@ check_single_block:
       sd->tok.type = TOKEN_EXEC;
       record_walk(sd, -1);
       stack_inc(sd, SSTACK__BLOCK);
+      outline_open(sd, OUTLINE__BLOCK, (sd->curr - 1)->prev.p);
       return 0;
 
     case TOKEN_CLOSE:
@@ -1132,6 +1264,7 @@ check_single_block:
         // ... top-level, invalid CLOSE
         debugf("invalid close\n");
       } else {
+       outline_close(sd);
        --sd->curr;  // pop out of block
  #ifdef DEBUG
         if (sd->curr->stype == SSTACK__CONTROL && sd->curr->prev.type == TOKEN_EXEC && !sd->curr->prev.p) {
@@ -1177,7 +1310,7 @@ check_single_block:
           }
         }
 
-        if (is_use_strict(&(sd->tok))) {
+        if (prsr_is_use_strict(&(sd->tok))) {
           debugf("setting 'use strict'\n");
           sd->curr->context |= CONTEXT__STRICT;
         }
@@ -1325,37 +1458,47 @@ void render_token(token *out, char *start) {
 #endif
 
 
-int prsr_simple(tokendef *td, int is_module, prsr_callback cb, void *arg) {
-#ifdef DEBUG
-  char *start = td->buf;
-#endif
-  simpledef sd;
-  bzero(&sd, sizeof(simpledef));
-  sd.curr = sd.stack;
-  sd.is_module = is_module;
+void prsr_simple_init(simpledef *sd, tokendef *td, int is_module, prsr_callback cb, void *arg) {
+  bzero(sd, sizeof(simpledef));
+  sd->curr = sd->stack;
+  sd->is_module = is_module;
   if (is_module) {
-    sd.curr->context = CONTEXT__STRICT;
+    sd->curr->context = CONTEXT__STRICT;
   }
-  sd.td = td;
-  sd.next = &(td->next);
-  sd.cb = cb;
-  sd.arg = arg;
+  sd->td = td;
+  sd->next = &(td->next);
+  sd->cb = cb;
+  sd->arg = arg;
+
+  sd->curr->stype = SSTACK__BLOCK;
+  record_walk(sd, -1);
+  sd->curr->prev.type = TOKEN_TOP;
+}
 
-  sd.curr->stype = SSTACK__BLOCK;
-  record_walk(&sd, -1);
-  sd.curr->prev.type = TOKEN_TOP;
 
-  int unchanged = 0;
+static int simple_run(simpledef *sd, int budget) {
+#ifdef DEBUG
+  char *start = sd->td->buf;
+#endif
   int ret = 0;
-  while (sd.tok.type) {
-    char *prev = sd.tok.p;
-    ret = simple_consume(&sd);
+  int limited = (budget > 0);
+  while (sd->tok.type) {
+    // nb. checked before any work, so the state is always resumable
+    if (limited && !budget--) {
+      return ERROR__BUDGET;
+    } else if (sd->cancel && atomic_load_explicit(sd->cancel, memory_order_relaxed)) {
+      return ERROR__BUDGET;
+    }
+
+    char *prev = sd->tok.p;
+    _stat(sd, steps);
+    ret = simple_consume(sd);
     if (ret) {
       break;
     }
 
     // check stack range
-    int depth = sd.curr - sd.stack;
+    int depth = sd->curr - sd->stack;
     if (depth >= __STACK_SIZE - 1 || depth < 0) {
       debugf("stack exception, depth=%d\n", depth);
       ret = ERROR__STACK;
@@ -1363,49 +1506,93 @@ int prsr_simple(tokendef *td, int is_module, prsr_callback cb, void *arg) {
     }
 
     // allow unchanged ptr for some attempts for state machine
-    if (prev == sd.tok.p) {
-      if (unchanged++ < 4) {
+    if (prev == sd->tok.p) {
+      _stat(sd, retry);
+      if (sd->unchanged++ < 4) {
         // we give it four chances to change something to let the state machine work
         // (needed for SSTACK__CONTROL)
         continue;
       }
-      debugf("simple_consume didn't consume: %d %.*s\n", sd.tok.type, sd.tok.len, sd.tok.p);
+      debugf("simple_consume didn't consume: %d %.*s\n", sd->tok.type, sd->tok.len, sd->tok.p);
       ret = ERROR__INTERNAL;
       break;
     }
 
     // success
-    prev = sd.tok.p;
-    unchanged = 0;
+    prev = sd->tok.p;
+    sd->unchanged = 0;
   }
 
   if (ret) {
     return ret;
   }
 
-  int depth = (sd.curr - sd.stack);
+  int depth = (sd->curr - sd->stack);
   while (depth) {
     debugf("end: sending TOKEN_EOF at depth=%d\n", depth);
-    simple_consume(&sd);
+    simple_consume(sd);
 
-    int update = (sd.curr - sd.stack);
+    int update = (sd->curr - sd->stack);
     if (update >= depth) {
       break;  // only allow state pop
     }
     depth = update;
   }
-  skip_walk(&sd, -1);  // emit 'real' EOF
+  skip_walk(sd, -1);  // emit 'real' EOF
+  if (sd->outline) {
+    outline_unwind(sd->outline, 0, sd->tok.p - sd->td->buf);
+  }
 
-  if (sd.curr != sd.stack) {
+  if (sd->curr != sd->stack) {
 #ifdef DEBUG
-    debugf("err: stack is %ld too high\n", sd.curr - sd.stack);
-    sstack *t = sd.stack;
+    debugf("err: stack is %ld too high\n", sd->curr - sd->stack);
+    sstack *t = sd->stack;
     do {
-      debugf("...[%ld] stype=%d\n", t - sd.stack, t->stype);
-      cb(sd.arg, &(t->prev));
-    } while (t != sd.curr && ++t);
+      debugf("...[%ld] stype=%d\n", t - sd->stack, t->stype);
+      sd->cb(sd->arg, &(t->prev));
+    } while (t != sd->curr && ++t);
 #endif
     return ERROR__STACK;
   }
   return 0;
 }
+
+int prsr_simple_run(simpledef *sd, int budget) {
+  if (!sd->done) {
+    int ret = simple_run(sd, budget);
+    if (ret == ERROR__BUDGET) {
+      return ret;
+    }
+    sd->done = 1;
+    sd->result = ret;
+    if (sd->outline) {
+      outline_compact(sd->outline);
+    }
+  }
+  return sd->result;
+}
+
+
+void prsr_outline_init(prsr_outline *o, prsr_outline_node *all, int max) {
+  bzero(o, sizeof(prsr_outline));
+  o->all = all;
+  o->max = max;
+  o->open = -1;
+}
+
+
+int prsr_simple_body(token *body, int preparse, prsr_callback cb, void *arg) {
+  tokendef td = prsr_init_token_at(body->p, body->p + body->len, body->line_no);
+  simpledef sd;
+  prsr_simple_init(&sd, &td, 0, cb, arg);
+  sd.curr->context = body->hash;
+  sd.preparse = preparse;
+  return prsr_simple_run(&sd, 0);
+}
+
+
+int prsr_simple(tokendef *td, int is_module, prsr_callback cb, void *arg) {
+  simpledef sd;
+  prsr_simple_init(&sd, td, is_module, cb, arg);
+  return prsr_simple_run(&sd, 0);
+}
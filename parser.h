@@ -1,3 +1,4 @@
+#include <stdatomic.h>
 #include "token.h"
 
 // context are set on all statements
@@ -5,5 +6,88 @@
 #define CONTEXT__ASYNC     2
 #define CONTEXT__GENERATOR 4
 
-typedef void (*prsr_callback)(void *, token *);
+#ifdef PRSR_STATS
+// Counts of slow or interesting paths, for -DPRSR_STATS builds only.
+typedef struct {
+  uint32_t steps;          // calls to the main state machine
+  uint32_t retry;          // steps that didn't consume a token (state machine only)
+  uint32_t slash;          // ambiguous slashes resolved by the parser
+  uint32_t close_op_next;  // calls to prsr_close_op_next
+  uint32_t async_resolve;  // "async" resolved later with MARK_RESOLVE
+  uint32_t virt;           // virtual tokens yielded
+  uint32_t virt_asi;       // ... of which were ASI
+  uint32_t push[8];        // stack pushes by stype (SSTACK__ in parser.c)
+} prsr_stats;
+#endif
+
+#define OUTLINE__FUNC  1  // function or method (from its first token), or arrow (from "=>") with body
+#define OUTLINE__CLASS 2  // class, from "class" to the close of its body
+#define OUTLINE__BLOCK 3  // braced block, e.g. "if (x) {...}" (not a function body)
+#define OUTLINE__DICT  4  // object literal
+
+// A function, class, block or dict found by the parser, stored in preorder.
+typedef struct {
+  uint32_t start;   // offset of its first token
+  uint32_t end;     // offset after its close (or of EOF if unclosed), or zero if parsing stopped
+  int32_t parent;   // index of the enclosing node, or -1 at top-level
+  uint8_t type;     // OUTLINE__
+  uint8_t depth;    // parser stack depth, used while open
+} prsr_outline_node;
+
+typedef struct {
+  prsr_outline_node *all;
+  int count;
+  int max;
+  int open;  // innermost open node, or -1
+  int full;  // set if nodes were lost as all was full (no more are recorded)
+} prsr_outline;
+
+// prepares o to record into all, which has space for max nodes
+void prsr_outline_init(prsr_outline *o, prsr_outline_node *all, int max);
+
+typedef struct {
+  token prev;           // previous token
+  uint32_t start;       // hash of stype start (set only for some stypes)
+  uint8_t stype : 3;    // stack type
+  uint8_t context : 3;  // current execution context (strict, async, generator)
+} sstack;
+
+typedef struct {
+  tokendef *td;
+  token *next;  // convenience
+  token tok;
+  int is_module;
+
+  prsr_callback cb;
+  void *arg;
+  int prev_line_no;
+  int unchanged;  // steps without progress
+  int done;       // set once the parse has finished, with its result below
+  int result;
+
+  atomic_int *cancel;    // if non-NULL and set, prsr_simple_run stops with ERROR__BUDGET
+  int preparse;          // if set, function bodies are yielded as one TOKEN_BODY between braces
+  prsr_outline *outline;  // if set, functions, classes, blocks and dicts are recorded here
+
+#ifdef PRSR_STATS
+  prsr_stats stats;  // counts since prsr_simple_init
+#endif
+
+  sstack *curr;
+  sstack stack[__STACK_SIZE];
+} simpledef;
+
 int prsr_simple(tokendef *, int is_module, prsr_callback, void *);
+
+// sets up sd to parse td via prsr_simple_run (sd and td must live until the parse is done)
+void prsr_simple_init(simpledef *sd, tokendef *td, int is_module, prsr_callback cb, void *arg);
+
+// runs at most budget steps (about one per token, or unlimited if zero), returns 0 once done or
+// ERROR__BUDGET if out of budget or cancelled, after which it may be called again to resume; once
+// finished, further calls just return the same result
+int prsr_simple_run(simpledef *sd, int budget);
+
+// parses a TOKEN_BODY from a preparse (with its context and lines) as if it were never skipped,
+// optionally skipping its own nested bodies, without modifying the source; as this is a parse of
+// its own, anything recorded by offset (e.g. outline or pairs) starts from the body
+int prsr_simple_body(token *body, int preparse, prsr_callback cb, void *arg);
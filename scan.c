@@ -0,0 +1,273 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+#include <string.h>
+#include "scan.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && !defined(PRSR_SCALAR)
+#define SCAN_X86
+#include <immintrin.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#endif
+
+#define SCAN_PROFILE_BLOCKS 64  // sample up to 4KB
+
+void prsr_scan_init(scanindex *s, char *p, char *end) {
+  bzero(s, sizeof(scanindex));
+  s->classify = prsr_scan_classifier();
+  s->start = p;
+  s->end = end;
+}
+
+void prsr_scan_partial(scanindex *s, char *base) {
+  char copy[64] __attribute__((aligned(64)));
+  char *from = base < s->start ? s->start : base;
+  char *to = base + 64 < s->end ? base + 64 : s->end;
+
+  bzero(copy, 64);  // before the input, and from its end
+  if (to > from) {
+    memcpy(copy + (from - base), from, to - from);
+  }
+  s->classify(s, copy);
+  s->base = base;
+}
+
+// Whitespace runs in minified code are almost always a single byte (e.g. "var x"), where checking
+// the byte directly beats walking the index. Other kernels still win there, so only this changes.
+void prsr_scan_profile(scanindex *s, char *p) {
+  if (!s->classify) {
+    return;
+  }
+
+  int space = 0;
+  int runs = 0;
+  uint64_t prev = 0;  // whitespace in last byte of previous block
+  char *base = (char *) ((uintptr_t) p & ~(uintptr_t) 63);
+  uint64_t ignore = (((uint64_t) 1) << (p - base)) - 1;  // bytes before p
+
+  for (int i = 0; i < SCAN_PROFILE_BLOCKS && base <= s->end; ++i) {
+    scan_block(s, base);  // nb. the input ends in NUL (even if padded), so this stops there
+    uint64_t ws = (s->space | s->newline) & ~ignore;
+    uint64_t zero = s->zero & ~ignore;
+    if (zero) {
+      ws &= (zero & -zero) - 1;  // ignore from first NUL
+    }
+    space += __builtin_popcountll(ws);
+    runs += __builtin_popcountll(ws & ~((ws << 1) | prev));
+    prev = ws >> 63;
+    if (zero) {
+      break;
+    }
+    ignore = 0;
+    base += 64;
+  }
+
+  // average run of less than ~1.25 bytes (and too little to tell) is minified
+  s->scalar_space = (runs >= 16 && space * 4 < runs * 5);
+  s->base = 0;
+}
+
+#ifdef SCAN_X86
+
+// matches bytes in [low,high], using signed compares (SSE2/AVX2 have no unsigned compare)
+#define _in_range(v, low, high) \
+    _mm_cmplt_epi8(_mm_add_epi8(v, _mm_set1_epi8((char) (0x80 - (low)))), \
+        _mm_set1_epi8((char) (0x80 + (high) - (low) + 1)))
+#define _eq(v, c) _mm_cmpeq_epi8(v, _mm_set1_epi8(c))
+#define _mask(v) ((uint64_t) (uint16_t) _mm_movemask_epi8(v))
+
+static void classify_sse2(scanindex *s, char *base) {
+  uint64_t space = 0, newline = 0, ident = 0, string = 0, star = 0, zero = 0;
+
+  for (int i = 0; i < 64; i += 16) {
+    __m128i v = _mm_load_si128((__m128i *) (base + i));
+
+    __m128i z = _eq(v, 0);
+    __m128i nl = _eq(v, '\n');
+    __m128i sp = _mm_or_si128(_eq(v, ' '), _mm_andnot_si128(nl, _in_range(v, '\t', '\r')));
+
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i id = _mm_or_si128(_in_range(lower, 'a', 'z'), _in_range(v, '0', '9'));
+    id = _mm_or_si128(id, _mm_or_si128(_eq(v, '$'), _eq(v, '_')));
+    id = _mm_or_si128(id, _mm_cmplt_epi8(v, _mm_setzero_si128()));  // UTF-8
+
+    __m128i str = _mm_or_si128(_eq(v, '\''), _eq(v, '"'));
+    str = _mm_or_si128(str, _mm_or_si128(_eq(v, '`'), _eq(v, '\\')));
+    str = _mm_or_si128(str, _mm_or_si128(_eq(v, '$'), _mm_or_si128(nl, z)));
+
+    space |= _mask(sp) << i;
+    newline |= _mask(nl) << i;
+    ident |= _mask(id) << i;
+    string |= _mask(str) << i;
+    star |= _mask(_eq(v, '*')) << i;
+    zero |= _mask(z) << i;
+  }
+
+  s->base = base;
+  s->space = space;
+  s->newline = newline;
+  s->ident = ident;
+  s->string = string;
+  s->star = star;
+  s->zero = zero;
+}
+
+#undef _in_range
+#undef _eq
+#undef _mask
+
+#define _in_range(v, low, high) \
+    _mm256_cmpgt_epi8(_mm256_set1_epi8((char) (0x80 + (high) - (low) + 1)), \
+        _mm256_add_epi8(v, _mm256_set1_epi8((char) (0x80 - (low)))))
+#define _eq(v, c) _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c))
+#define _mask(v) ((uint64_t) (uint32_t) _mm256_movemask_epi8(v))
+
+__attribute__((target("avx2")))
+static void classify_avx2(scanindex *s, char *base) {
+  uint64_t space = 0, newline = 0, ident = 0, string = 0, star = 0, zero = 0;
+
+  for (int i = 0; i < 64; i += 32) {
+    __m256i v = _mm256_load_si256((__m256i *) (base + i));
+
+    __m256i z = _eq(v, 0);
+    __m256i nl = _eq(v, '\n');
+    __m256i sp = _mm256_or_si256(_eq(v, ' '), _mm256_andnot_si256(nl, _in_range(v, '\t', '\r')));
+
+    __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i id = _mm256_or_si256(_in_range(lower, 'a', 'z'), _in_range(v, '0', '9'));
+    id = _mm256_or_si256(id, _mm256_or_si256(_eq(v, '$'), _eq(v, '_')));
+    id = _mm256_or_si256(id, _mm256_cmpgt_epi8(_mm256_setzero_si256(), v));  // UTF-8
+
+    __m256i str = _mm256_or_si256(_eq(v, '\''), _eq(v, '"'));
+    str = _mm256_or_si256(str, _mm256_or_si256(_eq(v, '`'), _eq(v, '\\')));
+    str = _mm256_or_si256(str, _mm256_or_si256(_eq(v, '$'), _mm256_or_si256(nl, z)));
+
+    space |= _mask(sp) << i;
+    newline |= _mask(nl) << i;
+    ident |= _mask(id) << i;
+    string |= _mask(str) << i;
+    star |= _mask(_eq(v, '*')) << i;
+    zero |= _mask(z) << i;
+  }
+
+  s->base = base;
+  s->space = space;
+  s->newline = newline;
+  s->ident = ident;
+  s->string = string;
+  s->star = star;
+  s->zero = zero;
+}
+
+#undef _in_range
+#undef _eq
+#undef _mask
+
+// AVX-512BW has unsigned compares and writes masks directly, so the whole block is one load
+#define _in_range(v, low, high) \
+    _mm512_cmple_epu8_mask(_mm512_sub_epi8(v, _mm512_set1_epi8(low)), _mm512_set1_epi8((high) - (low)))
+#define _eq(v, c) _mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8(c))
+
+__attribute__((target("avx512f,avx512bw")))
+static void classify_avx512(scanindex *s, char *base) {
+  __m512i v = _mm512_load_si512((void *) base);
+
+  uint64_t zero = _eq(v, 0);
+  uint64_t newline = _eq(v, '\n');
+  uint64_t lower = _in_range(_mm512_or_si512(v, _mm512_set1_epi8(0x20)), 'a', 'z');
+
+  s->base = base;
+  s->space = _eq(v, ' ') | (_in_range(v, '\t', '\r') & ~newline);
+  s->newline = newline;
+  s->ident = lower | _in_range(v, '0', '9') | _eq(v, '$') | _eq(v, '_') |
+      _mm512_movepi8_mask(v);  // UTF-8
+  s->string = _eq(v, '\'') | _eq(v, '"') | _eq(v, '`') | _eq(v, '\\') | _eq(v, '$') |
+      newline | zero;
+  s->star = _eq(v, '*');
+  s->zero = zero;
+}
+
+#undef _in_range
+#undef _eq
+
+typedef struct {
+  const char *name;
+  scan_classify classify;
+} scankernel;
+
+static const scankernel kernels[] = {
+  {"avx512", classify_avx512},
+  {"avx2", classify_avx2},
+  {"sse2", classify_sse2},
+  {"scalar", 0},
+};
+#define KERNEL_COUNT ((int) (sizeof(kernels) / sizeof(scankernel)))
+
+static _Atomic(const scankernel *) kernel;  // NULL until first chosen
+
+// checks cpuid once, preferring PRSR_KERNEL from the environment if set and supported; callers
+// racing the first check all choose the same kernel, so whichever is published last is harmless
+static const scankernel *kernel_select() {
+  const scankernel *k = atomic_load_explicit(&kernel, memory_order_acquire);
+  if (k) {
+    return k;
+  }
+
+  __builtin_cpu_init();
+  int supported[KERNEL_COUNT] = {
+    __builtin_cpu_supports("avx512bw"),
+    __builtin_cpu_supports("avx2"),
+    1,
+    1,
+  };
+
+  int choice = 0;
+  while (!supported[choice]) {
+    ++choice;
+  }
+
+  const char *env = getenv("PRSR_KERNEL");
+  for (int i = 0; env && i < KERNEL_COUNT; ++i) {
+    if (!strcmp(env, kernels[i].name) && supported[i]) {
+      choice = i;
+    }
+  }
+
+  k = &kernels[choice];
+  atomic_store_explicit(&kernel, k, memory_order_release);
+  return k;
+}
+
+scan_classify prsr_scan_classifier() {
+  return kernel_select()->classify;
+}
+
+const char *prsr_scan_kernel() {
+  return kernel_select()->name;
+}
+
+#else
+
+scan_classify prsr_scan_classifier() {
+  return 0;
+}
+
+const char *prsr_scan_kernel() {
+  return "scalar";
+}
+
+#endif
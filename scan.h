@@ -0,0 +1,136 @@
+/*
+ * Copyright 2019 Sam Thorogood. All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may not
+ * use this file except in compliance with the License. You may obtain a copy of
+ * the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+ * WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the
+ * License for the specific language governing permissions and limitations under
+ * the License.
+ */
+
+#include <stdint.h>
+
+#ifndef _SCAN_H
+#define _SCAN_H
+
+// What scan_until stops at. Everything stops at NUL.
+#define SCAN__SPACE   0  // non-whitespace
+#define SCAN__IDENT   1  // non-identifier (not [A-Za-z0-9$_] or UTF-8)
+#define SCAN__STRING  2  // quote, backslash, '$' or newline
+#define SCAN__COMMENT 3  // '*' or newline
+#define SCAN__LINE    4  // newline
+
+struct _scanindex;
+typedef void (*scan_classify)(struct _scanindex *, char *);
+
+// Structural index of a single 64-byte aligned block, one bit per byte (LSB first). This is built
+// lazily by a vectorized first stage as the tokenizer reaches each block, and walked by the
+// kernels below with ctz rather than byte-by-byte.
+typedef struct _scanindex {
+  scan_classify classify;  // builds the index, or NULL to use scalar kernels
+  char *start;             // first byte of the input
+  char *end;               // end of the input (its NUL), never read past
+  char *base;              // block described below
+  uint64_t space;          // ' ', \t, \v, \f, \r (not \n)
+  uint64_t newline;        // \n
+  uint64_t ident;          // identifier chars
+  uint64_t string;         // quotes, \\, '$', \n and NUL
+  uint64_t star;           // '*'
+  uint64_t zero;           // NUL
+
+  uint8_t scalar_space;    // whitespace runs are too short to index (minified input)
+} scanindex;
+
+// returns the best classifier for this CPU (checked once), or NULL to use scalar kernels; on x86
+// this can be overridden with PRSR_KERNEL=avx512|avx2|sse2|scalar in the environment
+scan_classify prsr_scan_classifier();
+
+// returns the name of the kernel chosen by prsr_scan_classifier
+const char *prsr_scan_kernel();
+
+// prepares s for the input from p to end (normally its NUL), choosing the classifier for this CPU
+void prsr_scan_init(scanindex *s, char *p, char *end);
+
+// classifies a block that isn't wholly inside the input via a NUL-padded copy, so that only bytes
+// of the input are ever read
+void prsr_scan_partial(scanindex *s, char *base);
+
+// samples up to the first few KB at p (within the input) to choose kernels for it (e.g. minified
+// or not)
+void prsr_scan_profile(scanindex *s, char *p);
+
+static inline uint64_t scan_stop(scanindex *s, int which) {
+  switch (which) {
+    case SCAN__SPACE:
+      return ~(s->space | s->newline);
+    case SCAN__IDENT:
+      return ~s->ident;
+    case SCAN__STRING:
+      return s->string;
+    case SCAN__COMMENT:
+      return s->star | s->newline | s->zero;
+    case SCAN__LINE:
+      return s->newline | s->zero;
+  }
+  return ~0;
+}
+
+// classifies the aligned block at base, which must overlap the input
+static inline void scan_block(scanindex *s, char *base) {
+  if (base >= s->start && base + 63 <= s->end) {
+    s->classify(s, base);
+  } else {
+    prsr_scan_partial(s, base);  // first or last block
+  }
+}
+
+// Finds the next stop byte at or after p. As NUL always stops, this never moves past the block
+// containing the end of the input.
+static inline char *scan_until(scanindex *s, char *p, int which) {
+  for (;;) {
+    char *base = (char *) ((uintptr_t) p & ~(uintptr_t) 63);
+    if (base != s->base) {
+      scan_block(s, base);
+    }
+    uint64_t stop = scan_stop(s, which) >> (p - base);
+    if (stop) {
+      return p + __builtin_ctzll(stop);
+    }
+    p = base + 64;
+  }
+}
+
+// as scan_until(SCAN__SPACE), but also counts newlines consumed
+static inline char *scan_space(scanindex *s, char *p, int *line_no) {
+  for (;;) {
+    char *base = (char *) ((uintptr_t) p & ~(uintptr_t) 63);
+    if (base != s->base) {
+      scan_block(s, base);
+    }
+    int off = p - base;
+    uint64_t stop = scan_stop(s, SCAN__SPACE) >> off;
+    uint64_t newline = s->newline >> off;
+    if (stop) {
+      int len = __builtin_ctzll(stop);
+      newline &= (((uint64_t) 1) << len) - 1;
+      p += len;
+    } else {
+      p = base + 64;
+    }
+    while (newline) {
+      ++(*line_no);
+      newline &= newline - 1;
+    }
+    if (stop) {
+      return p;
+    }
+  }
+}
+
+#endif//_SCAN_H
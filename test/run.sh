@@ -3,6 +3,6 @@
 cd "${BASH_SOURCE%/*}" || exit
 
 set -eu
-clang test.c ../*.c -o _tester
+clang test.c ../*.c -o _tester $@
 ./_tester
 rm _tester
@@ -1,7 +1,9 @@
 
 #include "../token.h"
 #include "../parser.h"
+#include "../module.h"
 #include <stdio.h>
+#include <string.h>
 #include <strings.h>
 #include <stdlib.h>
 
@@ -10,6 +12,8 @@ typedef struct _testdef {
   const char *input;
   int *expected;  // zero-terminated token types
   int is_module;
+  int is_json;
+  int budget;  // if non-zero, parse in slices of this many steps
   struct testdef *next;  // for failures
 } testdef;
 
@@ -57,7 +61,20 @@ int run_testdef(testdef *def) {
 
   printf(">> %s\n", def->name);
 
-  int out = prsr_simple(&td, def->is_module, testdef_step, &active);
+  int out;
+  if (def->is_json) {
+    out = prsr_json((char *) def->input, testdef_step, &active);
+  } else if (def->budget) {
+    simpledef sd;
+    prsr_simple_init(&sd, &td, def->is_module, testdef_step, &active);
+    int slices = 0;
+    while ((out = prsr_simple_run(&sd, def->budget)) == ERROR__BUDGET) {
+      ++slices;
+    }
+    printf("(resumed %d times)\n", slices);
+  } else {
+    out = prsr_simple(&td, def->is_module, testdef_step, &active);
+  }
   while (active.at + 1 < active.len) {
     token fake;
     bzero(&fake, sizeof(token));
@@ -80,13 +97,229 @@ int run_testdef(testdef *def) {
   return 0;
 }
 
+typedef struct {
+  const char **expected;  // NULL-terminated directive text
+  int at;
+  int error;
+} directiveactive;
+
+static void directive_step(void *arg, token *t) {
+  directiveactive *active = (directiveactive *) arg;
+  const char *expected = active->expected[active->at];
+  if (!expected) {
+    printf("%d: unexpected `%.*s`\n", active->at, t->len, t->p);
+    active->error = 1;
+    return;
+  }
+
+  ++active->at;
+  if (strlen(expected) != (size_t) t->len || memcmp(expected, t->p, t->len)) {
+    printf("%d: actual=`%.*s` expected=`%s`\n", active->at, t->len, t->p, expected);
+    active->error = 1;
+  } else {
+    printf("%d: ok `%.*s`\n", active->at, t->len, t->p);
+  }
+}
+
+int run_directives(const char *name, const char *input, int strict, const char **expected) {
+  directiveactive active = {
+    .expected = expected,
+    .at = 0,
+    .error = 0,
+  };
+
+  printf(">> %s\n", name);
+
+  int out = prsr_directives((char *) input, strlen(input), directive_step, &active);
+  if (out != strict) {
+    printf("ERROR: strict mismatch, actual=%d expected=%d\n", out, strict);
+    return 1;
+  } else if (expected[active.at]) {
+    printf("ERROR: missing directive `%s`\n", expected[active.at]);
+    return 1;
+  } else if (active.error) {
+    printf("ERROR\n");
+    return active.error;
+  }
+
+  printf("OK!\n");
+  return 0;
+}
+
+// records a failed test by name
+#define _fail(_name, _lerr) \
+{ \
+  err |= _lerr; \
+  last->next = malloc(sizeof(testdef)); \
+  last = (testdef *) last->next; \
+  bzero(last, sizeof(testdef)); \
+  last->name = _name; \
+  ++ecount; \
+}
+
+// runs a test by name, where _call prints any detail and returns non-zero on failure
+#define _test_run(_name, _call) \
+{ \
+  printf(">> %s\n", _name); \
+  int lerr = (_call); \
+  if (lerr) { \
+    _fail(_name, lerr); \
+  } \
+  printf("\n"); \
+  ++count; \
+}
+
+// defines a test for prsr_directives: args are expected directives, with a trailing comma
+#define _test_directives(_name, _input, _strict, ...) \
+{ \
+  const char *v[] = {__VA_ARGS__ NULL}; \
+  int lerr = run_directives(_name, _input, _strict, v); \
+  if (lerr) { \
+    _fail(_name, lerr); \
+  } \
+  printf("\n"); \
+  ++count; \
+}
+
 // defines a test for prsr: args must have a trailing comma
-#define _test(_name, _input, ...) \
+#define _test(_name, _input, ...) _test_mode(_name, _input, 0, 0, __VA_ARGS__)
+
+// defines a test for prsr, resumed after every _budget steps: args must have a trailing comma
+#define _test_budget(_name, _input, _budget, ...) _test_mode(_name, _input, 0, _budget, __VA_ARGS__)
+
+// defines a test for prsr_json: args must have a trailing comma
+#define _test_json(_name, _input, ...) _test_mode(_name, _input, 1, 0, __VA_ARGS__)
+
+// defines a test for prsr_json that must fail with the given error
+#define _test_json_error(_name, _input, _ret) _test_run(_name, run_json_error(_input, _ret))
+
+// defines a test for prsr_module_scan, with the refs it must yield (as per collect_refs)
+#define _test_module_scan(_name, _input, _expected) \
+    _test_run(_name, run_module_scan(_input, _expected))
+
+static void json_discard(void *arg, token *t) {
+  (void) arg;
+  (void) t;
+}
+
+static int run_json_error(char *input, int ret) {
+  int out = prsr_json(input, json_discard, NULL);
+  if (out != ret) {
+    printf("ERROR: actual=%d expected=%d\n", out, ret);
+    return 1;
+  }
+  printf("OK!\n");
+  return 0;
+}
+
+static void count_eof(void *arg, token *t) {
+  *((int *) arg) += (t->type == TOKEN_EOF);
+}
+
+// records up to 16 opens seen by a prsr_simple callback, to look up in pairs once it's done
+typedef struct {
+  char *opens[16];
+  int count;
+} paired;
+
+static void collect_opens(void *arg, token *t) {
+  paired *p = (paired *) arg;
+  if (t->len && strchr("([{$?", t->p[0]) && (t->p[0] != '?' || t->type == TOKEN_TERNARY) &&
+      p->count < 16) {
+    p->opens[p->count++] = t->p;
+  }
+}
+
+typedef struct {
+  uint32_t *ids;
+  int count;
+} collected;
+
+// records the ids of symbols (not keywords like "let")
+static void collect_ids(void *arg, token *t) {
+  collected *c = (collected *) arg;
+  if (t->type == TOKEN_SYMBOL && c->count < 16) {
+    c->ids[c->count++] = t->id;
+  }
+}
+
+// appends each ref as "type specifier name local;" (empty parts as "-")
+static void collect_refs(void *arg, prsr_module_ref *r) {
+  char *out = (char *) arg + strlen((char *) arg);
+  token *parts[] = {&(r->specifier), &(r->name), &(r->local)};
+  out += sprintf(out, "%d", r->type);
+  for (int i = 0; i < 3; ++i) {
+    token *t = parts[i];
+    out += t->len ? sprintf(out, " %.*s", t->len, t->p) : sprintf(out, " -");
+  }
+  sprintf(out, ";");
+}
+
+static int run_module_scan(char *input, const char *expected) {
+  char actual[512] = {0};
+  int out = prsr_module_scan(input, collect_refs, actual);
+  if (out || strcmp(actual, expected)) {
+    printf("ERROR: out=%d actual=%s\n", out, actual);
+    return 1;
+  }
+  printf("OK!\n");
+  return 0;
+}
+
+// records the types of up to 32 tokens, and the last TOKEN_BODY
+typedef struct {
+  int types[32];
+  int count;
+  token body;
+} preparsed;
+
+static void collect_preparse(void *arg, token *t) {
+  preparsed *p = (preparsed *) arg;
+  if (p->count < 32) {
+    p->types[p->count++] = t->type;
+  }
+  if (t->type == TOKEN_BODY) {
+    p->body = *t;
+  }
+}
+
+static int run_preparse(char *input, const int *expected, int expected_count) {
+  preparsed p = {0};
+  tokendef td = prsr_init_token(input);
+  simpledef sd;
+  prsr_simple_init(&sd, &td, 0, collect_preparse, &p);
+  sd.preparse = 1;
+  int out = prsr_simple_run(&sd, 0);
+  if (out || p.count != expected_count || memcmp(p.types, expected, sizeof(int) * expected_count)) {
+    printf("ERROR: out=%d count=%d expected=%d\n", out, p.count, expected_count);
+    return 1;
+  }
+  printf("OK!\n");
+  return 0;
+}
+
+// defines a test for a preparse, with the types it must yield (skipped bodies as TOKEN_BODY)
+#define _test_preparse(_name, _input, ...) \
+{ \
+  const int expected[] = {__VA_ARGS__}; \
+  _test_run(_name, run_preparse(_input, expected, sizeof(expected) / sizeof(int))); \
+}
+
+// defines a test for an outline, with the nodes it must record as {type, parent, start, end}
+#define _test_outline(_name, _input, ...) \
+{ \
+  const int expected[][4] = {__VA_ARGS__}; \
+  _test_run(_name, run_outline(_input, expected, sizeof(expected) / sizeof(expected[0]))); \
+}
+
+#define _test_mode(_name, _input, _is_json, _budget, ...) \
 { \
   testdef td; \
   td.name = _name; \
   td.input = _input; \
   td.is_module = _name[0] == '^'; \
+  td.is_json = _is_json; \
+  td.budget = _budget; \
   td.next = NULL; \
   int v[] = {__VA_ARGS__ TOKEN_EOF}; \
   td.expected = v; \
@@ -102,6 +335,275 @@ int run_testdef(testdef *def) {
   ++count; \
 }
 
+static int run_directives_without_callback() {
+  int out = prsr_directives("'use strict'\n//# sourceMappingURL=x.map", 39, NULL, NULL);
+  if (out != 1) {
+    printf("ERROR: strict mismatch, actual=%d expected=1\n", out);
+    return 1;
+  }
+  printf("OK!\n");
+  return 0;
+}
+
+static int run_cancel() {
+  atomic_int cancel = 1;
+  int eof = 0;
+  tokendef td = prsr_init_token("var x = 1;");
+  simpledef sd;
+  prsr_simple_init(&sd, &td, 0, count_eof, &eof);
+  sd.cancel = &cancel;
+  int out = prsr_simple_run(&sd, 0);
+  cancel = 0;
+  int resumed = prsr_simple_run(&sd, 0);
+  int again = prsr_simple_run(&sd, 0);  // already done, yields nothing
+  if (out != ERROR__BUDGET || resumed || again || eof != 1) {
+    printf("ERROR: actual=%d,%d,%d eof=%d expected=%d,0,0 eof=1\n", out, resumed, again, eof,
+        ERROR__BUDGET);
+    return 1;
+  }
+  printf("OK!\n");
+  return 0;
+}
+
+#ifdef PRSR_STATS
+static int run_stats() {
+  tokendef td = prsr_init_token("x = (a)\n/b/g\nasync () => 1");
+  simpledef sd;
+  prsr_simple_init(&sd, &td, 0, json_discard, NULL);
+  int out = prsr_simple_run(&sd, 0);
+  prsr_stats *s = &sd.stats;
+  printf("steps=%d slash=%d async_resolve=%d virt=%d virt_asi=%d\n",
+      s->steps, s->slash, s->async_resolve, s->virt, s->virt_asi);
+  if (out || s->slash != 1 || s->async_resolve != 1 || s->virt_asi < 2 || !s->steps) {
+    printf("ERROR: unexpected stats\n");
+    return 1;
+  }
+  printf("OK!\n");
+  return 0;
+}
+#endif
+
+static int run_intern() {
+  const char *names[] = {"foo", "bar", "foo", "bar", "baz", "foo", "x", "#x"};
+  uint32_t ids[16];
+  prsr_intern_slot slots[16];
+  prsr_intern in;
+  prsr_intern_init(&in, slots, 16);
+
+  tokendef td = prsr_init_token("foo.bar = foo + bar(baz, foo); let x = 'foo'; #x");
+  td.intern = &in;
+  collected c = {.ids = ids};
+  int out = prsr_simple(&td, 0, collect_ids, &c);
+
+  int ok = !out && c.count == 8 && in.count == 6;  // includes "let"
+  for (int i = 0; ok && i < c.count; ++i) {
+    for (int j = 0; j < i; ++j) {
+      ok &= (ids[i] == ids[j]) == !strcmp(names[i], names[j]);
+    }
+  }
+
+  // a name with the same hash as "foo" is still a different name
+  uint32_t foo = ids[0];
+  for (int i = 0; i < 16; ++i) {
+    if (slots[i].id == foo) {
+      slots[i].p = "fox";
+    }
+  }
+  ok &= prsr_intern_lit(&in, "foo", 3) == (uint32_t) in.count && in.count == 7;
+
+  if (!ok) {
+    printf("ERROR: out=%d names=%d distinct=%d\n", out, c.count, in.count);
+    return 1;
+  }
+  printf("OK!\n");
+  return 0;
+}
+
+static int run_decode_strings() {
+  const char *input = "'a\\nb' + \"\\x41\\u0042\\u{43}\\uD83D\\uDE00\\\n\" + `x${y}\\`z\r\n` + 'it\\'s\\101\\0'";
+  const char *expected[] = {"a\nb", "ABC\xf0\x9f\x98\x80", "x", "`z\n", "it'sA"};
+  const uint32_t expected_len[] = {3, 7, 1, 3, 6};
+  char data[256];
+  prsr_string all[16];
+  prsr_strings strings;
+  prsr_strings_init(&strings, data, sizeof(data), all, 16);
+
+  tokendef td = prsr_init_token((char *) input);
+  td.strings = &strings;
+  int out = prsr_simple(&td, 0, json_discard, NULL);
+
+  int ok = !out && strings.count == 5;
+  for (int i = 0; ok && i < 5; ++i) {
+    prsr_string *v = &all[i];
+    ok = (v->len == expected_len[i] && !memcmp(data + v->offset, expected[i], v->len));
+    if (!ok) {
+      printf("ERROR: %d: actual=`%.*s`\n", i, (int) v->len, data + v->offset);
+    }
+  }
+
+  // ids stop where they would no longer fit in token.id
+  strings.count = DECODE__MAX_ID;
+  strings.max = DECODE__MAX_ID + 1;
+  ok &= !prsr_decode_string(&strings, "'x'", 3, 0) && strings.full;
+
+  if (!ok) {
+    printf("ERROR: out=%d strings=%d\n", out, strings.count);
+    return 1;
+  }
+  printf("OK!\n");
+  return 0;
+}
+
+static int run_decode_numbers() {
+  const char *input = "[1e-5, 0x1F, 1_000n, .5e10, 017, 08.5, 0b1_01, 0.1, 9007199254740993, "
+      "0xffffffffffffffffffn, 1__0, 1..toString(), 0_1, 07.5]";
+  const double expected[] = {
+    1e-5, 31, 1000, .5e10, 15, 8.5, 5, 0.1, 9007199254740992, 0, 10, 1, 1, 7.5,
+  };
+  const uint32_t expected_flags[] = {
+    0, 0, NUMBER__BIGINT, 0, NUMBER__LEGACY, NUMBER__LEGACY, 0, 0, 0,
+    NUMBER__BIGINT | NUMBER__WRAPPED, NUMBER__INVALID, 0, NUMBER__INVALID,
+    NUMBER__LEGACY | NUMBER__INVALID,
+  };
+  prsr_number all[16];
+  prsr_numbers numbers;
+  prsr_numbers_init(&numbers, all, 16);
+
+  tokendef td = prsr_init_token((char *) input);
+  td.numbers = &numbers;
+  int out = prsr_simple(&td, 0, json_discard, NULL);
+
+  int ok = !out && numbers.count == 14;
+  for (int i = 0; ok && i < 14; ++i) {
+    prsr_number *v = &all[i];
+    if (v->flags & NUMBER__BIGINT) {
+      ok = (v->bigint == (expected_flags[i] & NUMBER__WRAPPED ? ~0ULL : (uint64_t) expected[i]));
+    } else {
+      ok = (v->value == expected[i]);
+    }
+    ok = ok && v->flags == expected_flags[i];
+    if (!ok) {
+      printf("ERROR: %d: actual=%.17g flags=%d\n", i, v->value, v->flags);
+    }
+  }
+
+  // ids stop where they would no longer fit in token.id
+  numbers.count = NUMBER__MAX_ID;
+  numbers.max = NUMBER__MAX_ID + 1;
+  ok &= !prsr_decode_number(&numbers, "1", 1) && numbers.full;
+
+  if (!ok) {
+    printf("ERROR: out=%d numbers=%d\n", out, numbers.count);
+    return 1;
+  }
+  printf("OK!\n");
+  return 0;
+}
+
+static int run_preparse_body() {
+  char input[] = "function f(a) {\n  if (a) { return /}/ }\n}\nasync x => {\n  await y;\n}";
+  const int expected[] = {
+    TOKEN_KEYWORD, TOKEN_SYMBOL, TOKEN_PAREN, TOKEN_SYMBOL, TOKEN_CLOSE,  // function f(a)
+    TOKEN_EXEC, TOKEN_BODY, TOKEN_CLOSE,                                  // {...}
+    TOKEN_KEYWORD, TOKEN_SYMBOL, TOKEN_ARROW,                             // async x =>
+    TOKEN_EXEC, TOKEN_BODY, TOKEN_CLOSE, TOKEN_SEMICOLON, TOKEN_EOF,      // {...} ASI
+  };
+  const int expected_body[] = {TOKEN_OP, TOKEN_SYMBOL, TOKEN_SEMICOLON, TOKEN_EOF};  // await y;
+  preparsed p = {0};
+  tokendef td = prsr_init_token(input);
+  simpledef sd;
+  prsr_simple_init(&sd, &td, 0, collect_preparse, &p);
+  sd.preparse = 1;
+  int out = prsr_simple_run(&sd, 0);
+  int ok = !out && p.count == 16 && !memcmp(p.types, expected, sizeof(expected));
+
+  // the async body, parsed later, still treats "await" as an op
+  preparsed lazy = {0};
+  int lazy_out = prsr_simple_body(&p.body, 0, collect_preparse, &lazy);
+  ok = ok && !lazy_out && lazy.count == 4 && !memcmp(lazy.types, expected_body, sizeof(expected_body));
+  ok = ok && p.body.line_no == 4 && input[p.body.p - input + p.body.len] == '}';
+  if (!ok) {
+    printf("ERROR: out=%d,%d count=%d,%d\n", out, lazy_out, p.count, lazy.count);
+    return 1;
+  }
+  printf("OK!\n");
+  return 0;
+}
+
+static int run_outline(char *input, const int (*expected)[4], int expected_count) {
+  prsr_outline_node all[16];
+  prsr_outline outline;
+  prsr_outline_init(&outline, all, 16);
+  tokendef td = prsr_init_token(input);
+  simpledef sd;
+  prsr_simple_init(&sd, &td, 0, json_discard, NULL);
+  sd.outline = &outline;
+  int out = prsr_simple_run(&sd, 0);
+
+  int ok = !out && outline.count == expected_count && outline.open == -1;
+  for (int i = 0; ok && i < expected_count; ++i) {
+    prsr_outline_node *n = &all[i];
+    ok = (n->type == expected[i][0] && n->parent == expected[i][1] &&
+        n->start == (uint32_t) expected[i][2] && n->end == (uint32_t) expected[i][3]);
+    if (!ok) {
+      printf("ERROR: %d: type=%d parent=%d %u-%u\n", i, n->type, n->parent, n->start, n->end);
+    }
+  }
+  if (!ok) {
+    printf("ERROR: out=%d count=%d\n", out, outline.count);
+    return 1;
+  }
+  printf("OK!\n");
+  return 0;
+}
+
+static int run_pairs() {
+  const char *input = "f(a[1], `x${b ? c : d}`) // c\n{}";
+  const uint32_t expected[32] = {[1] = 23, [3] = 5, [10] = 21, [14] = 18, [30] = 31};
+  uint32_t close[32];
+  prsr_pairs pairs;
+  prsr_pairs_init(&pairs, close, 32);
+
+  tokendef td = prsr_init_token((char *) input);
+  td.pairs = &pairs;
+  token out;
+  while (td.next.type || td.pending.len) {
+    prsr_next_token(&td, &out, 0);
+  }
+
+  if (pairs.full || memcmp(close, expected, sizeof(expected))) {
+    printf("ERROR: full=%d\n", pairs.full);
+    return 1;
+  }
+  printf("OK!\n");
+  return 0;
+}
+
+static int run_pairs_simple() {
+  char input[] = "async (a) => { if (b) { c = [d ? e : f] } }\n/* x */ g(`${h}`, {i})";
+  uint32_t close[sizeof(input)];
+  prsr_pairs pairs;
+  prsr_pairs_init(&pairs, close, sizeof(input));
+
+  tokendef td = prsr_init_token(input);
+  td.pairs = &pairs;
+  paired p = {0};
+  int out = prsr_simple(&td, 0, collect_opens, &p);
+
+  int bad = 0;
+  for (int i = 0; i < p.count; ++i) {
+    char c = p.opens[i][0];
+    uint32_t at = close[p.opens[i] - input];
+    bad += (!at || input[at] != (c == '(' ? ')' : c == '[' ? ']' : c == '?' ? ':' : '}'));
+  }
+  if (out || p.count != 9 || bad) {
+    printf("ERROR: out=%d opens=%d bad=%d\n", out, p.count, bad);
+    return 1;
+  }
+  printf("OK!\n");
+  return 0;
+}
+
 int main() {
   int err = 0;
   int count = 0;
@@ -767,6 +1269,240 @@ int main() {
     TOKEN_SEMICOLON, // ASI ;
   );
 
+  _test("optional chaining is not ternary", "a?.b ?? {}",
+    TOKEN_SYMBOL,    // a
+    TOKEN_OP,        // ?.
+    TOKEN_SYMBOL,    // b
+    TOKEN_OP,        // ??
+    TOKEN_DICT,      // {
+    TOKEN_CLOSE,     // }
+    TOKEN_SEMICOLON, // ASI ;
+  );
+
+  // nb. "??=" is escaped, as it's otherwise a trigraph in strict C
+  _test("optional call and index", "f?.(a)?.[0]\nx ?\?= y",
+    TOKEN_SYMBOL,    // f
+    TOKEN_OP,        // ?.
+    TOKEN_PAREN,     // (
+    TOKEN_SYMBOL,    // a
+    TOKEN_CLOSE,     // )
+    TOKEN_OP,        // ?.
+    TOKEN_ARRAY,     // [
+    TOKEN_NUMBER,    // 0
+    TOKEN_CLOSE,     // ]
+    TOKEN_SEMICOLON, // ASI ;
+    TOKEN_SYMBOL,    // x
+    TOKEN_OP,        // ??=
+    TOKEN_SYMBOL,    // y
+    TOKEN_SEMICOLON, // ASI ;
+  );
+
+  _test("ternary before decimal", "a?.5:1",
+    TOKEN_SYMBOL,    // a
+    TOKEN_TERNARY,   // ?
+    TOKEN_NUMBER,    // .5
+    TOKEN_CLOSE,     // :
+    TOKEN_NUMBER,    // 1
+    TOKEN_SEMICOLON, // ASI ;
+  );
+
+  _test_directives("directives", "'use strict';\n'foo'\n/* @license MIT */ var x;",
+    1,
+    "'use strict'",
+    "'foo'",
+    "/* @license MIT */",
+  );
+
+  _test_directives("directive stops at expression", "'use strict' + 1;\n'foo';",
+    0,
+  );
+
+  _test_directives("directive with ASI", "\"use strict\"\nin_x;\n'foo'\nin x",
+    1,
+    "\"use strict\"",
+  );
+
+  _test_directives("pragma comments", "#!/usr/bin/env node\n// @ts-check\n/**\n * @jsx h\n */\n"
+      "// foo@example.com\nfoo();\n//# sourceMappingURL=foo.js.map\n",
+    0,
+    "// @ts-check",
+    "/**\n * @jsx h\n */",
+    "//# sourceMappingURL=foo.js.map",
+  );
+
+  _test_directives("pragma in block comment", "foo();\n/*\n// @ts-check */\n",
+    0,
+    "/*\n// @ts-check */",
+  );
+
+  _test_directives("pragma in template", "var x = `\n//# sourceMappingURL=x.map\n`;\n",
+    0,
+  );
+
+  _test_directives("pragma after code", "foo(/* @a */); // @ts-ignore\n",
+    0,
+    "// @ts-ignore",
+  );
+
+  _test_directives("trailing pragmas", "x = '/*';\nfoo(); /*! a */\n// @b */\n//# c\n",
+    0,
+    "/*! a */",
+    "// @b */",
+    "//# c",
+  );
+
+  _test_run("directives without callback", run_directives_without_callback());
+
+  _test_json("json", "{\"a\": [1, -2.5e+3, true],\n\"b\": {}, \"c\": null}",
+    TOKEN_DICT,      // {
+    TOKEN_LABEL,     // "a"
+    TOKEN_COLON,     // :
+    TOKEN_ARRAY,     // [
+    TOKEN_NUMBER,    // 1
+    TOKEN_OP,        // ,
+    TOKEN_NUMBER,    // -2.5e+3
+    TOKEN_OP,        // ,
+    TOKEN_KEYWORD,   // true
+    TOKEN_CLOSE,     // ]
+    TOKEN_OP,        // ,
+    TOKEN_LABEL,     // "b"
+    TOKEN_COLON,     // :
+    TOKEN_DICT,      // {
+    TOKEN_CLOSE,     // }
+    TOKEN_OP,        // ,
+    TOKEN_LABEL,     // "c"
+    TOKEN_COLON,     // :
+    TOKEN_KEYWORD,   // null
+    TOKEN_CLOSE,     // }
+  );
+
+  _test_json("json string value", " \"foo\\\"\" ",
+    TOKEN_STRING,    // "foo\""
+  );
+
+  _test_json_error("json trailing comma", "[1,]", ERROR__SYNTAX);
+  _test_json_error("json unquoted key", "{a: 1}", ERROR__SYNTAX);
+  _test_json_error("json mismatched close", "[1}", ERROR__STACK);
+  _test_json_error("json unclosed", "{\"a\": 1", ERROR__STACK);
+  _test_json_error("json empty", " ", ERROR__SYNTAX);
+  _test_json_error("json raw tab", "\"a\tb\"", ERROR__SYNTAX);
+  _test_json_error("json line continuation", "\"a\\\nb\"", ERROR__SYNTAX);
+  _test_json_error("json hex escape", "\"\\x41\"", ERROR__SYNTAX);
+  _test_json_error("json short unicode escape", "\"\\u12\"", ERROR__SYNTAX);
+  _test_json_error("json leading zero", "[01]", ERROR__SYNTAX);
+  _test_json_error("json negative leading zero", "-00.5", ERROR__SYNTAX);
+
+  _test_json("json escapes", "[\"\\u00e9\\/\\n\", 0, -0.5]",
+    TOKEN_ARRAY,     // [
+    TOKEN_STRING,    // "\u00e9\/\n"
+    TOKEN_OP,        // ,
+    TOKEN_NUMBER,    // 0
+    TOKEN_OP,        // ,
+    TOKEN_NUMBER,    // -0.5
+    TOKEN_CLOSE,     // ]
+  );
+
+  _test_budget("budget resumes", "if (x) {\n  foo(/re/)\n} else a\n/b/g", 1,
+    TOKEN_KEYWORD,   // if
+    TOKEN_PAREN,     // (
+    TOKEN_SYMBOL,    // x
+    TOKEN_CLOSE,     // )
+    TOKEN_EXEC,      // {
+    TOKEN_SYMBOL,    // foo
+    TOKEN_PAREN,     // (
+    TOKEN_REGEXP,    // /re/
+    TOKEN_CLOSE,     // )
+    TOKEN_SEMICOLON, // ASI
+    TOKEN_CLOSE,     // }
+    TOKEN_KEYWORD,   // else
+    TOKEN_EXEC,      // virtual
+    TOKEN_SYMBOL,    // a
+    TOKEN_OP,        // /
+    TOKEN_SYMBOL,    // b
+    TOKEN_OP,        // /
+    TOKEN_SYMBOL,    // g
+    TOKEN_SEMICOLON, // ASI
+    TOKEN_CLOSE,     // virtual
+  );
+
+  _test_run("cancel", run_cancel());
+
+  _test_run("intern", run_intern());
+
+  _test_run("decode strings", run_decode_strings());
+
+  _test_run("decode numbers", run_decode_numbers());
+
+  _test_module_scan("module scan", "import x, {y as z} from './a';\nexport * as ns from 'b'\n"
+      "export const {p, q: [r]} = require('c'), s = 1;\n"
+      "function f() { return /[)]/.test(`${import('d')}`) && x.require('no') }\n"
+      "export default class {}",
+      "1 './a' - x;1 './a' y z;2 'b' ns *;2 - p p;2 - r r;4 'c' - -;"
+      "2 - s s;3 'd' - -;2 - default -;");
+
+  // agrees with a full parse, as a slash after a value on a new line is still a divide
+  _test_module_scan("module scan divide after newline",
+      "function f() { return x\n/require('a')/g }",
+      "4 'a' - -;");
+
+  // disagrees with a full parse, which also finds 'a': inside a group, a slash after "}" is read as
+  // a regexp (blocks being more common there than dicts), but the scan recovers at the next one
+  _test_module_scan("module scan divide after dict",
+      "function f() { x = {} / require('a') / 2; require('b') }",
+      "4 'b' - -;");
+
+  // "${" starts an expression, so a slash there is a regexp, even one with a "/" in a class
+  _test_module_scan("module scan regexp in template",
+      "f(`${/[/]/g}`, `x${y}${/]/}`);\nrequire('a')",
+      "4 'a' - -;");
+
+  _test_module_scan("module scan regexp with slash in class",
+      "function f() { return /[/(]/.test(x) && require('a') }",
+      "4 'a' - -;");
+
+  _test_module_scan("module scan regexp after control paren",
+      "function f() { if (x) /require('a')/.test(y); while (y.if (z) / require('b') / 2) {} }",
+      "4 'b' - -;");
+
+  _test_run("preparse", run_preparse_body());
+
+  // the skip reads a slash after the close of "if (x)" as a regexp, not as a divide
+  _test_preparse("preparse regexp after control paren", "function f(){ if (x) /}/.test(y) } g()",
+      TOKEN_KEYWORD, TOKEN_SYMBOL, TOKEN_PAREN, TOKEN_CLOSE,  // function f()
+      TOKEN_EXEC, TOKEN_BODY, TOKEN_CLOSE,                    // {...}
+      TOKEN_SYMBOL, TOKEN_PAREN, TOKEN_CLOSE, TOKEN_SEMICOLON, TOKEN_EOF);  // g() ASI
+
+  // a regexp (with "/" in a class) directly inside "${" doesn't unbalance the skipped body
+  _test_preparse("preparse regexp in template", "function f() { return `${/[/]/g}`; } g()",
+      TOKEN_KEYWORD, TOKEN_SYMBOL, TOKEN_PAREN, TOKEN_CLOSE,  // function f()
+      TOKEN_EXEC, TOKEN_BODY, TOKEN_CLOSE,                    // {...}
+      TOKEN_SYMBOL, TOKEN_PAREN, TOKEN_CLOSE, TOKEN_SEMICOLON, TOKEN_EOF);  // g() ASI
+
+  _test_outline("outline",
+      "var a = {b: function() { return {c: 1} }, d() {}, e: x => { if (y) {} }};\n"
+      "class F extends G { h() {} }",
+      {OUTLINE__DICT, -1, 8, 72},
+      {OUTLINE__FUNC, 0, 12, 40},
+      {OUTLINE__DICT, 1, 32, 38},
+      {OUTLINE__FUNC, 0, 42, 48},
+      {OUTLINE__FUNC, 0, 55, 71},
+      {OUTLINE__BLOCK, 4, 67, 69},
+      {OUTLINE__CLASS, -1, 74, 102},
+      {OUTLINE__FUNC, 6, 94, 100});
+
+  // the invalid function is dropped, and its dict moves up to top-level
+  _test_outline("outline drop", "x = function ({a: 1}) 1; {b}",
+      {OUTLINE__DICT, -1, 14, 20},
+      {OUTLINE__BLOCK, -1, 25, 28});
+
+  _test_run("bracket pairs", run_pairs());
+
+  _test_run("bracket pairs via prsr_simple", run_pairs_simple());
+
+#ifdef PRSR_STATS
+  _test_run("stats", run_stats());
+#endif
+
   // restate all errors
   testdef *p = &fail;
   if (ecount) {
@@ -75,7 +75,35 @@ static int consume_slash_regexp(char *p) {
   }
 }
 
-static int consume_string(char *p, int *line_no, int *litflag) {
+static int consume_number(char *p) {
+  char *start = p;
+
+  char prefix = p[1] | 0x20;
+  if (p[0] == '0' && (prefix == 'x' || prefix == 'o' || prefix == 'b')) {
+    p += 2;
+  } else {
+    while (isdigit(*p) || *p == '_') {
+      ++p;
+    }
+    if (*p == '.') {
+      // nb. a second dot is "1..toString()"
+      do {
+        ++p;
+      } while (isdigit(*p) || *p == '_');
+    }
+    if ((*p | 0x20) == 'e' && (p[1] == '+' || p[1] == '-') && isdigit(p[2])) {
+      p += 2;
+    }
+  }
+
+  // digits, exponent, "n" suffix: letters etc are misuse, which is invalid, so eat anyway
+  while (isalnum(*p) || *p == '_') {
+    ++p;
+  }
+  return p - start;
+}
+
+static int consume_string(scanindex *s, char *p, int *line_no, int *litflag) {
   int len;
   char start;
   if (*litflag) {
@@ -88,7 +116,11 @@ static int consume_string(char *p, int *line_no, int *litflag) {
   }
 
   for (;;) {
-    char c = p[++len];
+    ++len;
+    if (s->classify) {
+      len = scan_until(s, p + len, SCAN__STRING) - p;
+    }
+    char c = p[len];
     if (c == start) {
       ++len;
       return len;
@@ -126,7 +158,7 @@ static int consume_string(char *p, int *line_no, int *litflag) {
   return len;
 }
 
-static eat_out eat_token(char *p, token *prev) {
+static eat_out eat_token(scanindex *s, char *p, token *prev) {
 #define _ret(_len, _type) ((eat_out) {_len, _type, 0});
 #define _reth(_len, _type, _hash) ((eat_out) {_len, _type, _hash});
   const char start = p[0];
@@ -200,6 +232,12 @@ static eat_out eat_token(char *p, token *prev) {
       return _ret(1, TOKEN_SEMICOLON);
 
     case '?':
+      // "??", "??=" and "?." (but not "?.5") are ops, not ternaries
+      if (p[1] == '?') {
+        return _ret(p[2] == '=' ? 3 : 2, TOKEN_OP);
+      } else if (p[1] == '.' && !isdigit(p[2])) {
+        return _ret(2, TOKEN_OP);
+      }
       return _ret(1, TOKEN_TERNARY);
 
     case ':':
@@ -292,18 +330,10 @@ static eat_out eat_token(char *p, token *prev) {
     return _ret(len, TOKEN_OP);
   } while (0);
 
-  // number: "0", ".01", "0x100"
+  // number: "0", ".01", "0x100", "1_000n", "1e-5"
   const char next = p[1];
   if (isdigit(start) || (start == '.' && isdigit(next))) {
-    int len = 1;
-    char c = next;
-    for (;;) {
-      if (!(isalnum(c) || c == '.')) {  // letters, dots, etc- misuse is invalid, so eat anyway
-        break;
-      }
-      c = p[++len];
-    }
-    return _ret(len, TOKEN_NUMBER);
+    return _ret(consume_number(p), TOKEN_NUMBER);
   }
 
   // dot notation (not a number)
@@ -322,6 +352,14 @@ static eat_out eat_token(char *p, token *prev) {
   } else {
     len = consume_known_lit(p, &hash);
   }
+  if (s->classify && (len || isalpha(start) || start == '$' || start == '_' || start < 0)) {
+    // skip any simple remainder, e.g. "ifx" or "foo"
+    int rest = scan_until(s, p + (len ? len : 1), SCAN__IDENT) - p;
+    if (rest != len) {
+      hash = 0;
+      len = rest;
+    }
+  }
   char c = p[len];
   do {
     // FIXME: escapes aren't valid in literals, but check whether this matches UTF-8
@@ -358,9 +396,13 @@ static eat_out eat_token(char *p, token *prev) {
 #undef _reth
 }
 
-static inline char *internal_consume_multiline_comment(char *p, int *line_no) {
+static inline char *internal_consume_multiline_comment(scanindex *s, char *p, int *line_no) {
   for (;;) {
-    char c = *(++p);
+    ++p;
+    if (s->classify) {
+      p = scan_until(s, p, SCAN__COMMENT);
+    }
+    char c = *p;
     switch (c) {
       case '\n':
         ++(*line_no);
@@ -378,14 +420,14 @@ static inline char *internal_consume_multiline_comment(char *p, int *line_no) {
   }
 }
 
-static int consume_comment(char *p, int *line_no, int start) {
+static int consume_comment(scanindex *s, char *p, int *line_no, int start) {
   char *from = p;
 
   switch (*p) {
     case '/': {
       char next = *(++p);
       if (next == '*') {
-        return internal_consume_multiline_comment(p, line_no) - from;
+        return internal_consume_multiline_comment(s, p, line_no) - from;
       } else if (next != '/') {
         return 0;
       }
@@ -403,6 +445,9 @@ static int consume_comment(char *p, int *line_no, int start) {
   }
 
   // match single-line comment
+  if (s->classify) {
+    return scan_until(s, p, SCAN__LINE) - from;
+  }
   for (;;) {
     char c = *p;
     if (c == '\n' || !c) {
@@ -413,7 +458,11 @@ static int consume_comment(char *p, int *line_no, int start) {
   return p - from;
 }
 
-static char *consume_space(char *p, int *line_no) {
+static char *consume_space(scanindex *s, char *p, int *line_no) {
+  if (s->classify && !s->scalar_space) {
+    return scan_space(s, p, line_no);
+  }
+
   char c;
 #define _check() \
     c = *p; \
@@ -463,6 +512,7 @@ static void eat_next(tokendef *d) {
   char *from = d->next.p + d->next.len;
 
   // short-circuit for token state machine
+  d->resumed = 0;
   if (d->flag) {
     if (d->flag == FLAG__PENDING_T_BRACE) {
       d->next.type = TOKEN_T_BRACE;
@@ -470,8 +520,9 @@ static void eat_next(tokendef *d) {
       d->flag = 0;
     } else if (d->flag == FLAG__RESUME_LIT) {
       int litflag = 1;
+      d->resumed = 1;
       d->next.type = TOKEN_STRING;
-      d->next.len = consume_string(from, &d->line_no, &litflag);
+      d->next.len = consume_string(&(d->index), from, &d->line_no, &litflag);
       d->flag = litflag ? FLAG__PENDING_T_BRACE : 0;
     }
     d->next.p = from;
@@ -479,22 +530,23 @@ static void eat_next(tokendef *d) {
   }
 
   // always consume space chars
-  char *p = consume_space(from, &d->line_no);
+  char *p = consume_space(&(d->index), from, &d->line_no);
   d->pending.p = p;
   d->pending.line_no = d->line_no;
 
   // match comments (C99 and long), record first in pending
-  int len = consume_comment(p, &d->line_no, p == d->buf);
+  int len = consume_comment(&(d->index), p, &d->line_no, p == d->buf);
   d->pending.len = len;
   d->line_after_pending = d->line_no;
   while (len) {
     p += len;
-    p = consume_space(p, &d->line_no);
-    len = consume_comment(p, &d->line_no, 0);
+    p = consume_space(&(d->index), p, &d->line_no);
+    len = consume_comment(&(d->index), p, &d->line_no, 0);
   }
 
-  // match real token
-  eat_out eat = eat_token(p, &(d->next));
+  // match real token (or stop at the end)
+  eat_out eat = (d->end && p >= d->end) ? (eat_out) {0, TOKEN_EOF, 0} :
+      eat_token(&(d->index), p, &(d->next));
   d->next.type = eat.type;
   d->next.hash = eat.hash;
   d->next.line_no = d->line_no;
@@ -510,7 +562,7 @@ static void eat_next(tokendef *d) {
     case TOKEN_STRING: {
       // consume string
       int litflag = 0;
-      d->next.len = consume_string(p, &d->line_no, &litflag);
+      d->next.len = consume_string(&(d->index), p, &d->line_no, &litflag);
       if (litflag) {
         d->flag = FLAG__PENDING_T_BRACE;
       }
@@ -531,7 +583,7 @@ int prsr_next_token(tokendef *d, token *out, int has_value) {
     // copy pending comment out, try to yield more
     memcpy(out, &d->pending, sizeof(token));
 
-    char *p = consume_space(d->pending.p + d->pending.len, &d->line_after_pending);
+    char *p = consume_space(&(d->index), d->pending.p + d->pending.len, &d->line_after_pending);
     if (p == d->next.p) {
       d->pending.len = 0;
       return 0;  // nothing to do, reached real token
@@ -540,7 +592,7 @@ int prsr_next_token(tokendef *d, token *out, int has_value) {
     // queue up upcoming comment
     d->pending.p = p;
     d->pending.line_no = d->line_after_pending;
-    d->pending.len = consume_comment(p, &d->line_after_pending, 0);
+    d->pending.len = consume_comment(&(d->index), p, &d->line_after_pending, 0);
 
     if (!d->pending.len) {
       return ERROR__INTERNAL;
@@ -552,6 +604,24 @@ int prsr_next_token(tokendef *d, token *out, int has_value) {
 
   // actually enact token
   switch (out->type) {
+    case TOKEN_LIT:
+      if (d->intern) {
+        out->id = prsr_intern_lit(d->intern, out->p, out->len);
+      }
+      break;
+
+    case TOKEN_STRING:
+      if (d->strings) {
+        out->id = prsr_decode_string(d->strings, out->p, out->len, d->resumed);
+      }
+      break;
+
+    case TOKEN_NUMBER:
+      if (d->numbers) {
+        out->id = prsr_decode_number(d->numbers, out->p, out->len);
+      }
+      break;
+
     case TOKEN_SLASH:
       // consume this token as lookup can't know what it was
       if (has_value < 0) {
@@ -580,6 +650,14 @@ int prsr_next_token(tokendef *d, token *out, int has_value) {
         eat_next(d);  // consume invalid open but return error
         return ERROR__STACK;
       }
+      if (d->pairs) {
+        prsr_pairs *p = d->pairs;
+        uint32_t at = out->p - d->buf;
+        if (at >= p->max) {
+          p->full = 1;
+        }
+        p->open[d->depth] = at;
+      }
       d->stack[d->depth++] = out->type;
       break;
 
@@ -592,6 +670,13 @@ int prsr_next_token(tokendef *d, token *out, int has_value) {
       if (type == TOKEN_T_BRACE) {
         d->flag |= FLAG__RESUME_LIT;
       }
+      if (d->pairs) {
+        prsr_pairs *p = d->pairs;
+        uint32_t open = p->open[d->depth];
+        if (open < p->max) {
+          p->close[open] = out->p - d->buf;
+        }
+      }
       break;
   }
 
@@ -599,6 +684,220 @@ int prsr_next_token(tokendef *d, token *out, int has_value) {
   return 0;
 }
 
+static inline int is_ident(char c) {
+  return isalnum(c) || c == '$' || c == '_' || c < 0;
+}
+
+// returns the hash of the known literal at word, or zero if it's only the start of a longer name
+static uint32_t skip_word_hash(char *word) {
+  uint32_t hash = 0;
+  int len = consume_known_lit(word, &hash);
+  return is_ident(word[len]) ? 0 : hash;
+}
+
+// is a slash a regexp, after last (the last char of the previous token) or word (if an identifier)
+static int skip_slash_is_regexp(char last, char *word) {
+  switch (last) {
+    case ')':
+    case ']':
+    case '"':
+    case '0':
+      return 0;  // nb. the close of "if (x)" is tracked by the caller
+    case 'a':
+      return (skip_word_hash(word) & _MASK_KEYWORD) != 0;
+  }
+  return 1;  // including after '}', as blocks are more common than dicts here
+}
+
+// consumes any space and comments
+static char *skip_space(scanindex *s, char *p, int *line_no) {
+  for (;;) {
+    p = consume_space(s, p, line_no);
+    int len = consume_comment(s, p, line_no, 0);
+    if (!len) {
+      return p;
+    }
+    p += len;
+  }
+}
+
+// yields the call at word (of len bytes) if it's "name(", and its argument if "name('x')"
+static void skip_yield_call(scanindex *s, char *word, int len, int line_no, prsr_callback cb, void *arg) {
+  char *p = skip_space(s, word + len, &line_no);
+  if (*p != '(') {
+    return;
+  }
+  token t = {.p = word, .len = len, .line_no = line_no, .type = TOKEN_LIT};
+  cb(arg, &t);
+
+  p = skip_space(s, p + 1, &line_no);
+  if (*p != '\'' && *p != '"' && *p != '`') {
+    return;
+  }
+  int litflag = 0;
+  int string_line = line_no;
+  int string_len = consume_string(s, p, &line_no, &litflag);
+  if (litflag || string_len < 2 || p[string_len - 1] != p[0]) {
+    return;  // template with parts, or unterminated
+  }
+  char *after = skip_space(s, p + string_len, &line_no);
+  if (*after == ')' || *after == ',') {
+    token str = {.p = p, .len = string_len, .line_no = string_line, .type = TOKEN_STRING};
+    cb(arg, &str);
+  }
+}
+
+// finds the close of the group that p is inside, or the NUL at the end of the source; if comments
+// is non-NULL, sets it to the start of any comments directly before that close (or to NULL)
+static char *skip_to_close(scanindex *s, char *p, int *line_no, prsr_callback cb, void *arg,
+    char **comments) {
+  uint8_t templates[__STACK_SIZE];  // depths at which each open "${" is closed
+  int count = 0;
+  int controls[__STACK_SIZE];  // depths at which each open "if (", "while (" etc is closed
+  int control_count = 0;
+  int depth = 0;
+  char last = '(';
+  char *word = NULL;
+  int member = 0;  // whether word follows a "."
+  char *run = NULL;  // start of the current run of comments
+
+  for (;;) {
+    p = consume_space(s, p, line_no);
+    char c = *p;
+    if (c == '/') {
+      int len = consume_comment(s, p, line_no, 0);
+      if (len) {
+        run = run ? run : p;
+        p += len;
+        continue;
+      }
+    }
+    if (comments) {
+      *comments = run;
+    }
+    run = NULL;
+
+    switch (c) {
+      case 0:
+        return p;
+
+      case '(':
+        if (last == 'a' && !member && control_count < __STACK_SIZE &&
+            (skip_word_hash(word) & _MASK_CONTROL_PAREN)) {
+          controls[control_count++] = depth + 1;
+        }
+        // fall-through
+
+      case '[':
+      case '{':
+        ++depth;
+        break;
+
+      case ')':
+      case ']':
+      case '}':
+        if (!depth) {
+          return p;
+        }
+        if (c == ')' && control_count && controls[control_count - 1] == depth) {
+          // a statement follows "if (x)", so a slash there starts a regexp
+          --control_count;
+          --depth;
+          ++p;
+          last = '(';
+          continue;
+        }
+        if (c == '}' && count && templates[count - 1] == depth) {
+          // resume template literal
+          --count;
+          --depth;
+          int litflag = 1;
+          p += 1 + consume_string(s, p + 1, line_no, &litflag);
+          if (litflag) {
+            if (count == __STACK_SIZE) {
+              return p;
+            }
+            templates[count++] = ++depth;
+            p += 2;  // "${"
+          }
+          last = litflag ? '(' : '"';  // nb. "${" starts an expression, like "("
+          continue;
+        }
+        --depth;
+        break;
+
+      case '\'':
+      case '"':
+      case '`': {
+        int litflag = 0;
+        p += consume_string(s, p, line_no, &litflag);
+        if (litflag) {
+          if (count == __STACK_SIZE) {
+            return p;
+          }
+          templates[count++] = ++depth;
+          p += 2;  // "${"
+        }
+        last = litflag ? '(' : '"';  // nb. "${" starts an expression, like "("
+        continue;
+      }
+
+      case '/':
+        if (skip_slash_is_regexp(last, word)) {
+          p += consume_slash_regexp(p);
+          last = '"';
+          continue;
+        }
+        break;
+
+      default:
+        if (isdigit(c) || (c == '.' && isdigit(p[1]))) {
+          p += consume_number(p);
+          last = '0';
+          continue;
+        } else if (!is_ident(c) && c != '#') {
+          break;
+        }
+
+        char *start = p++;
+        if (s->classify) {
+          p = scan_until(s, p, SCAN__IDENT);
+        }
+        while (is_ident(*p)) {
+          ++p;
+        }
+        if (cb && last != '.' && !(last == 'a' && p - word == 8 && !memcmp(word, "function", 8))) {
+          skip_yield_call(s, start, p - start, *line_no, cb, arg);
+        }
+        word = start;
+        member = (last == '.');
+        last = 'a';
+        continue;
+    }
+
+    last = c;
+    ++p;
+  }
+}
+
+int prsr_skip_group(tokendef *d, prsr_callback cb, void *arg) {
+  if (!d->depth || d->stack[d->depth - 1] == TOKEN_TERNARY) {
+    return ERROR__INTERNAL;
+  }
+
+  // restart from the lookahead (or any comment before it), as if it hadn't been read
+  token *from = d->pending.len ? &(d->pending) : &(d->next);
+  d->line_no = from->line_no;
+  char *p = skip_to_close(&(d->index), from->p, &d->line_no, cb, arg, NULL);
+
+  d->pending.len = 0;
+  d->flag = 0;
+  d->next.p = p;
+  d->next.len = 0;
+  eat_next(d);
+  return d->next.type == TOKEN_EOF ? ERROR__STACK : 0;
+}
+
 void prsr_close_op_next(tokendef *d) {
   if (d->next.type == TOKEN_OP && d->next.p[0] == '/') {
     // change to TOKEN_REGEXP
@@ -609,10 +908,17 @@ void prsr_close_op_next(tokendef *d) {
 }
 
 tokendef prsr_init_token(char *p) {
+  return prsr_init_token_at(p, NULL, 1);
+}
+
+tokendef prsr_init_token_at(char *p, char *end, int line_no) {
   tokendef d;
   bzero(&d, sizeof(d));
   d.buf = p;
-  d.line_no = 1;
+  d.end = end;
+  d.line_no = line_no;
+  prsr_scan_init(&(d.index), p, end ? end : p + strlen(p));
+  prsr_scan_profile(&(d.index), p);
 
   d.pending.type = TOKEN_COMMENT;
   d.next.p = p;  // place next cursor
@@ -620,3 +926,412 @@ tokendef prsr_init_token(char *p) {
   eat_next(&d);
   return d;
 }
+
+int prsr_is_use_strict(token *t) {
+  if (t->type != TOKEN_STRING || t->len != 12) {
+    return 0;
+  }
+  return !memcmp(t->p, "'use strict'", 12) || !memcmp(t->p, "\"use strict\"", 12);
+}
+
+// matches comments that tools care about, e.g. "//# sourceMappingURL=", "/*! preserved */",
+// "// @ts-check" or "/** @jsx h */" (also "@license" anywhere inside a block comment)
+static int is_pragma_comment(char *p, int len) {
+  if (len < 3 || p[0] != '/') {
+    return 0;  // includes hashbang
+  }
+
+  // leading "//#", "//@", "/*!", "/*#" or "/**@"
+  int at = 2;
+  if (p[1] == '*') {
+    if (p[2] == '!') {
+      return 1;
+    }
+    while (at < len && p[at] == '*') {
+      ++at;
+    }
+  }
+  while (at < len && (p[at] == ' ' || p[at] == '\t')) {
+    ++at;
+  }
+  if (at + 1 < len && (p[at] == '#' || p[at] == '@') && (p[at + 1] == ' ' || isalpha(p[at + 1]))) {
+    return 1;
+  }
+
+  // "@foo" following whitespace or '*' anywhere (not e.g. "foo@example.com")
+  char *end = p + len - 1;
+  char *q = p + 2;
+  while ((q = memchr(q, '@', end - q))) {
+    if ((isspace(q[-1]) || q[-1] == '*') && isalpha(q[1])) {
+      return 1;
+    }
+    ++q;
+  }
+  return 0;
+}
+
+// consumes space and comments, yielding pragma comments if cb is non-NULL
+static char *directive_skip(scanindex *s, char *p, int *line_no, char *buf, prsr_callback cb, void *arg) {
+  for (;;) {
+    p = consume_space(s, p, line_no);
+    int line_start = *line_no;
+    int len = consume_comment(s, p, line_no, p == buf);
+    if (!len) {
+      return p;
+    }
+    if (cb && is_pragma_comment(p, len)) {
+      token t = {.p = p, .len = len, .line_no = line_start, .type = TOKEN_COMMENT};
+      cb(arg, &t);
+    }
+    p += len;
+  }
+}
+
+// is this the end of a string statement, e.g. "'use strict'" followed by ';', '}' or a newline
+// that would generate ASI (loosely matches the lookahead inside prsr_simple)
+static int is_directive_end(char *p, int newline) {
+  char c = *p;
+  if (c == ';' || c == '}' || !c) {
+    return 1;
+  } else if (!newline) {
+    return 0;
+  }
+
+  // ... "in" or "instanceof" continue the expression
+  uint32_t hash = 0;
+  int len = consume_known_lit(p, &hash);
+  if (hash & _MASK_REL_OP) {
+    char after = p[len];
+    if (!(isalnum(after) || after == '$' || after == '_' || after < 0)) {
+      return 0;
+    }
+  }
+
+  if ((c == '+' || c == '-') && p[1] == c) {
+    return 1;  // ++/-- causes ASI
+  } else if (c == '!' || c == '~') {
+    return p[1] != '=';  // unary ops cause ASI, but not "!="
+  }
+  return !memchr("=<>&|^%+-*/?:.,([`", c, 18);
+}
+
+// skims one line from p to end as code, returns the start of its "//" comment, end if it has none,
+// or NULL if that's unclear (a template or unterminated string or comment, which may span lines)
+static char *skim_line_comment(char *p, char *end) {
+  for (; p < end; ++p) {
+    char c = *p;
+    if (c == '`') {
+      return NULL;
+    } else if (c == '\'' || c == '"') {
+      for (++p; p < end && *p != c; ++p) {
+        p += (*p == '\\');
+      }
+      if (p >= end) {
+        return NULL;
+      }
+    } else if (c == '/' && p + 1 < end && p[1] == '/') {
+      return p;
+    } else if (c == '/' && p + 1 < end && p[1] == '*') {
+      for (p += 2; p + 1 < end && !(p[0] == '*' && p[1] == '/'); ++p);
+      if (p + 1 >= end) {
+        return NULL;
+      }
+      ++p;
+    }
+  }
+  return end;
+}
+
+// finds the run of comments ending the source between start and end, by skimming back line by line
+// and stopping at the first token that isn't a comment, returns NULL if there's none (or it's
+// unclear, e.g. the last line is inside a template)
+static char *trailing_comments(char *start, char *end) {
+  char *region = NULL;
+  for (;;) {
+    while (end > start && isspace(end[-1])) {
+      --end;
+    }
+    char *line = end;
+    while (line > start && line[-1] != '\n') {
+      --line;
+    }
+
+    char *c = NULL;
+    if (end - start >= 4 && end[-2] == '*' && end[-1] == '/') {
+      // block comments don't nest, so this ends at the nearest "/*" (on this line or before), as
+      // long as that isn't itself inside a string or comment
+      for (c = end - 4; c > start && !(c[0] == '/' && c[1] == '*'); --c);
+      if (c[0] == '/' && c[1] == '*') {
+        char *at = c;
+        while (at > start && at[-1] != '\n') {
+          --at;
+        }
+        c = (skim_line_comment(at, c) == c) ? c : NULL;
+      } else {
+        c = NULL;
+      }
+    }
+    if (!c) {
+      // nb. also catches a "//" comment that happens to end with "*/"
+      c = skim_line_comment(line, end);
+      c = (c && c < end) ? c : NULL;
+    }
+    if (!c) {
+      return region;
+    }
+    region = end = c;
+  }
+}
+
+int prsr_directives(char *buf, int len, prsr_callback cb, void *arg) {
+  int line_no = 1;
+  int strict = 0;
+  char *p = buf;
+  scanindex s;
+  prsr_scan_init(&s, buf, buf + len);
+
+  // directive prologue: only strings (and comments) may lead the file
+  for (;;) {
+    p = directive_skip(&s, p, &line_no, buf, cb, arg);
+    if (*p != '\'' && *p != '"') {
+      break;
+    }
+
+    int litflag = 0;
+    int string_line = line_no;
+    int string_len = consume_string(&s, p, &line_no, &litflag);
+    if (string_len < 2 || p[string_len - 1] != p[0]) {
+      break;  // unterminated
+    }
+
+    int after_line = line_no;
+    char *after = directive_skip(&s, p + string_len, &after_line, buf, NULL, NULL);
+    if (!is_directive_end(after, after_line != line_no)) {
+      break;  // e.g. "'use strict' + 1"
+    }
+
+    token t = {.p = p, .len = string_len, .line_no = string_line, .type = TOKEN_STRING};
+    strict |= prsr_is_use_strict(&t);
+    if (cb) {
+      cb(arg, &t);
+    }
+
+    // yield any pragmas between the string and its ';'
+    p = directive_skip(&s, p + string_len, &line_no, buf, cb, arg);
+    if (*p == ';') {
+      ++p;
+    }
+  }
+
+  // trailing comments, e.g. "//# sourceMappingURL=", found by skimming back from the end
+  char *region = trailing_comments(p, buf + len);
+  if (!region) {
+    return strict;
+  }
+
+  // count lines to the trailing region, then yield its pragmas
+  for (char *q = p; q < region; ++q) {
+    line_no += (*q == '\n');
+  }
+  directive_skip(&s, region, &line_no, buf, cb, arg);
+  return strict;
+}
+
+// matches a JSON number, e.g. "-12.5e+3"
+static int consume_json_number(char *p) {
+  char *start = p;
+  if (*p == '-') {
+    ++p;
+  }
+  if (!isdigit(*p) || (p[0] == '0' && isdigit(p[1]))) {
+    return 0;  // nb. no leading zeros
+  }
+  while (isdigit(*p)) {
+    ++p;
+  }
+  if (*p == '.') {
+    if (!isdigit(*(++p))) {
+      return 0;
+    }
+    while (isdigit(*p)) {
+      ++p;
+    }
+  }
+  if (*p == 'e' || *p == 'E') {
+    ++p;
+    if (*p == '+' || *p == '-') {
+      ++p;
+    }
+    if (!isdigit(*p)) {
+      return 0;
+    }
+    while (isdigit(*p)) {
+      ++p;
+    }
+  }
+  return p - start;
+}
+
+// checks the JSON string at p (of len bytes, including quotes) has no raw control characters or
+// escapes JSON lacks, such as line continuations, "\x41" or "\'"
+static int json_string_ok(char *p, int len) {
+  char *end = p + len - 1;
+  for (++p; p < end; ++p) {
+    if ((unsigned char) *p < 0x20) {
+      return 0;
+    } else if (*p != '\\') {
+      continue;
+    }
+    switch (*(++p)) {
+      case '"':
+      case '\\':
+      case '/':
+      case 'b':
+      case 'f':
+      case 'n':
+      case 'r':
+      case 't':
+        continue;
+      case 'u':
+        for (int i = 1; i <= 4; ++i) {
+          if (!isxdigit(p[i])) {
+            return 0;
+          }
+        }
+        p += 4;
+        continue;
+    }
+    return 0;
+  }
+  return 1;
+}
+
+#define JSON__VALUE 0  // want a value
+#define JSON__OPEN  1  // want a value or close, container just opened
+#define JSON__NEXT  2  // want ',' or close (or ':' after key)
+
+int prsr_json(char *buf, prsr_callback cb, void *arg) {
+  scanindex s;
+  prsr_scan_init(&s, buf, buf + strlen(buf));
+  uint8_t stack[__STACK_SIZE];  // TOKEN_ARRAY, or TOKEN_DICT/TOKEN_LABEL/TOKEN_COLON for dict
+  int depth = 0;
+  int want = JSON__VALUE;
+  int line_no = 1;
+  char *p = buf;
+  token t;
+  bzero(&t, sizeof(token));
+
+  for (;;) {
+    p = consume_space(&s, p, &line_no);
+    t.p = p;
+    t.line_no = line_no;
+    t.hash = 0;
+    t.len = 1;
+
+    char c = *p;
+    uint8_t top = depth ? stack[depth - 1] : 0;
+    switch (c) {
+      case 0:
+        if (depth) {
+          return ERROR__STACK;
+        } else if (want != JSON__NEXT) {
+          return ERROR__SYNTAX;
+        }
+        t.type = TOKEN_EOF;
+        t.len = 0;
+        t.line_no = 0;
+        cb(arg, &t);
+        return 0;
+
+      case '{':
+      case '[':
+        if (want == JSON__NEXT || top == TOKEN_DICT) {
+          return ERROR__SYNTAX;  // nb. dict keys must be strings
+        } else if (depth == __STACK_SIZE) {
+          return ERROR__STACK;
+        }
+        t.type = (c == '{' ? TOKEN_DICT : TOKEN_ARRAY);
+        stack[depth++] = t.type;
+        want = JSON__OPEN;
+        break;
+
+      case '}':
+      case ']':
+        if (!depth || (c == ']') != (top == TOKEN_ARRAY)) {
+          return ERROR__STACK;
+        } else if (want == JSON__VALUE || (want == JSON__NEXT && top == TOKEN_LABEL)) {
+          return ERROR__SYNTAX;
+        }
+        t.type = TOKEN_CLOSE;
+        t.hash = (c == ']' ? MISC_RARRAY : 0);
+        --depth;
+        want = JSON__NEXT;
+        break;
+
+      case ',':
+        if (want != JSON__NEXT || !depth || top == TOKEN_LABEL) {
+          return ERROR__SYNTAX;
+        }
+        t.type = TOKEN_OP;
+        t.hash = MISC_COMMA;
+        if (top == TOKEN_COLON) {
+          stack[depth - 1] = TOKEN_DICT;
+        }
+        want = JSON__VALUE;
+        break;
+
+      case ':':
+        if (want != JSON__NEXT || top != TOKEN_LABEL) {
+          return ERROR__SYNTAX;
+        }
+        t.type = TOKEN_COLON;
+        t.hash = MISC_COLON;
+        stack[depth - 1] = TOKEN_COLON;
+        want = JSON__VALUE;
+        break;
+
+      case '"': {
+        if (want == JSON__NEXT) {
+          return ERROR__SYNTAX;
+        }
+        int litflag = 0;
+        t.len = consume_string(&s, p, &line_no, &litflag);
+        if (t.len < 2 || p[t.len - 1] != '"' || !json_string_ok(p, t.len)) {
+          return ERROR__SYNTAX;
+        }
+
+        // strings in key position are labels, and must be followed by ':'
+        if (top == TOKEN_DICT) {
+          t.type = TOKEN_LABEL;
+          stack[depth - 1] = TOKEN_LABEL;
+        } else {
+          t.type = TOKEN_STRING;
+        }
+        want = JSON__NEXT;
+        break;
+      }
+
+      default:
+        if (want == JSON__NEXT || top == TOKEN_DICT) {
+          return ERROR__SYNTAX;
+        } else if (c == '-' || isdigit(c)) {
+          t.type = TOKEN_NUMBER;
+          t.len = consume_json_number(p);
+        } else {
+          t.type = TOKEN_KEYWORD;
+          t.len = consume_known_lit(p, &t.hash);
+          if (t.hash != LIT_TRUE && t.hash != LIT_FALSE && t.hash != LIT_NULL) {
+            t.len = 0;
+          }
+        }
+        if (!t.len) {
+          return ERROR__SYNTAX;
+        }
+        want = JSON__NEXT;
+        break;
+    }
+
+    cb(arg, &t);
+    p += t.len;
+  }
+}
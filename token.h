@@ -16,12 +16,18 @@
 
 #include <stdint.h>
 #include "types.h"
+#include "scan.h"
+#include "intern.h"
+#include "decode.h"
+#include "number.h"
+#include "pairs.h"
 
 #ifndef _TOKEN_H
 #define _TOKEN_H
 
 typedef struct {
   char *buf;
+  char *end;      // if set, tokens stop here (with TOKEN_EOF) rather than at the NUL
   int line_no;    // after next
   token next;     // next useful token
   token pending;  // pending comment
@@ -29,12 +35,51 @@ typedef struct {
 
   // depth/flag used to record ${} state (resume literal once brace done)
   uint8_t flag : 2;
+  uint8_t resumed : 1;  // next is a template chunk after "}"
   uint16_t depth : __STACK_SIZE_BITS;
   uint8_t stack[__STACK_SIZE];
+
+  scanindex index;  // structural index of the current block
+
+  // if set (after prsr_init_token), literals are interned into token.id
+  prsr_intern *intern;
+
+  // if set, strings and template chunks are decoded, with token.id their index in strings->all + 1
+  prsr_strings *strings;
+
+  // if set, numbers are decoded, with token.id their index in numbers->all + 1
+  prsr_numbers *numbers;
+
+  // if set, each open token is linked to its close in pairs->close, by source offset
+  prsr_pairs *pairs;
 } tokendef;
 
+typedef void (*prsr_callback)(void *, token *);
+
 int prsr_next_token(tokendef *d, token *out, int has_value);
 void prsr_close_op_next(tokendef *d);
+
+// skips the rest of the group opened by the token just returned by prsr_next_token ("(", "[",
+// "{" or "${") without tokenizing it, so that its close is next; if cb is set, yields the name of
+// each plain call inside (e.g. "foo" of "foo(" but not of "x.foo("), then its argument if that's
+// a single string, returns 0 or ERROR__STACK if unclosed
+int prsr_skip_group(tokendef *d, prsr_callback cb, void *arg);
+
 tokendef prsr_init_token(char *p);
 
+// as prsr_init_token, but for source from p up to end (or its NUL, if end is NULL) starting at
+// line_no, e.g. a function body within a larger source
+tokendef prsr_init_token_at(char *p, char *end, int line_no);
+int prsr_is_use_strict(token *t);
+
+// yields the directive prologue and pragma comments of buf (of len bytes, and buf[len] must be NUL)
+// without a full parse, and any trailing pragmas found by skimming back from the end, cb may be
+// NULL, returns 1 if 'use strict' was found
+int prsr_directives(char *buf, int len, prsr_callback cb, void *arg);
+
+// tokenizes buf as JSON: yields TOKEN_DICT, TOKEN_ARRAY, TOKEN_CLOSE, TOKEN_LABEL (for keys),
+// TOKEN_COLON, TOKEN_OP (for commas), TOKEN_STRING, TOKEN_NUMBER and TOKEN_KEYWORD (true, false,
+// null), and a final TOKEN_EOF
+int prsr_json(char *buf, prsr_callback cb, void *arg);
+
 #endif//_TOKEN_H
@@ -0,0 +1,66 @@
+#!/usr/bin/env node
+
+// Writes pow10.h: 128-bit mantissas of the powers of ten, rounded down, as used by the
+// Eisel-Lemire fast path in number.c.
+
+const fs = require('fs');
+const now = new Date;
+
+const minExp10 = -348;
+const maxExp10 = +347;
+
+const one = BigInt(1);
+const mask64 = (one << BigInt(64)) - one;
+
+function bitLength(v) {
+  return v.toString(2).length;
+}
+
+// returns the top 128 bits of 10^q, rounded down
+function mantissa(q) {
+  const ten = BigInt(10);
+  if (q >= 0) {
+    const v = ten ** BigInt(q);
+    const shift = bitLength(v) - 128;
+    return shift >= 0 ? v >> BigInt(shift) : v << BigInt(-shift);
+  }
+
+  // 2^b / 10^-q, with b large enough that the result has at least 128 bits
+  const d = ten ** BigInt(-q);
+  const b = bitLength(d) + 128;
+  const v = (one << BigInt(b)) / d;
+  return v >> BigInt(bitLength(v) - 128);
+}
+
+function hex(v) {
+  return '0x' + v.toString(16).padStart(16, '0');
+}
+
+function main() {
+  const rows = [];
+  for (let q = minExp10; q <= maxExp10; ++q) {
+    const m = mantissa(q);
+    rows.push(`  {${hex(m & mask64)}, ${hex(m >> BigInt(64))}},  // 1e${q}`);
+  }
+
+  const output = `// Generated on ${now}
+
+#ifndef _POW10_H
+#define _POW10_H
+
+#include <stdint.h>
+
+#define POW10__MIN_EXP10 ${minExp10}
+#define POW10__MAX_EXP10 ${maxExp10}
+
+// {low, high} 64 bits of the 128-bit mantissa of each power of ten, rounded down
+static const uint64_t pow10_table[${rows.length}][2] = {
+${rows.join('\n')}
+};
+
+#endif//_POW10_H
+`;
+  fs.writeFileSync('pow10.h', output);
+}
+
+main();
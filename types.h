@@ -23,6 +23,8 @@
 #define ERROR__STACK    -2  // stack didn't balance
 #define ERROR__VALUE    -3  // ambiguous slash (internal error)
 #define ERROR__ASSERT   -4
+#define ERROR__SYNTAX   -5  // invalid input (only for strict modes, e.g. JSON)
+#define ERROR__BUDGET   -6  // parse paused (budget or cancel), may be resumed
 
 #define __STACK_SIZE      256  // stack size used by token
 #define __STACK_SIZE_BITS 8    // bits needed for __STACK_SIZE
@@ -33,6 +35,7 @@ typedef struct {
   int line_no;
   uint8_t type : 5;
   uint8_t mark : 3;
+  uint32_t id : 24;  // side value, if enabled on tokendef (or zero): see intern, strings and numbers
   uint32_t hash;
 } token;
 
@@ -60,6 +63,7 @@ typedef struct {
 #define TOKEN_SYMBOL    17
 #define TOKEN_KEYWORD   18
 #define TOKEN_LABEL     19  // to the left of a ':', e.g. 'foo:'
+#define TOKEN_BODY      20  // skipped function body (preparse only), hash is its CONTEXT__ flags
 
 // internal/ambiguous tokens
 #define TOKEN_TOP       28  // never reported, top of function or program
@@ -12,7 +12,7 @@ void internal_callback(void *arg, token *out) {
 
 typedef struct {
   tokendef td;
-  int is_module;
+  simpledef sd;
 } runnerdef;
 
 // number of bytes wasm must give us to store parser state
@@ -26,14 +26,14 @@ EMSCRIPTEN_KEEPALIVE
 int prsr_setup(void *at, char *buf, int is_module) {
   runnerdef *rd = (runnerdef *) at;
   rd->td = prsr_init_token(buf);
-  rd->is_module = is_module;
+  prsr_simple_init(&(rd->sd), &(rd->td), is_module, internal_callback, at);
   return 0;
 }
 
 EMSCRIPTEN_KEEPALIVE
-int prsr_run(void *at) {
+int prsr_run(void *at, int budget) {
   runnerdef *rd = (runnerdef *) at;
 
-  // TODO: make this yield a few tokens at a time
-  return prsr_simple(&(rd->td), rd->is_module, internal_callback, at);
+  // returns ERROR__BUDGET if there's more to do, call again to continue
+  return prsr_simple_run(&(rd->sd), budget);
 }